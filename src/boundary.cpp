@@ -0,0 +1,166 @@
+#include "boundary.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+#include "io.h"
+#include "obj.h"
+#include "thread_pool.h"
+
+namespace tnp {
+
+// Positive if a, b, c turn counterclockwise
+float cross(const Eigen::Vector2f& a, const Eigen::Vector2f& b,
+            const Eigen::Vector2f& c) {
+  const Eigen::Vector2f u = b - a;
+  const Eigen::Vector2f v = c - a;
+  return u.x() * v.y() - u.y() * v.x();
+}
+
+std::vector<uint> convex_hull(const std::vector<Eigen::Vector2f>& points) {
+  std::vector<uint> order(points.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint a, uint b) {
+    return points[a].x() < points[b].x() ||
+           (points[a].x() == points[b].x() && points[a].y() < points[b].y());
+  });
+  if (order.size() < 3) return order;
+
+  // Lower hull from left to right then upper hull from right to left, the
+  // last vertex of each is the first of the other
+  std::vector<uint> hull(2 * order.size());
+  uint size = 0;
+  auto add = [&](uint i, uint min_size) {
+    while (size >= min_size &&
+           cross(points[hull[size - 2]], points[hull[size - 1]], points[i]) <=
+               0)
+      size--;
+    hull[size++] = i;
+  };
+  for (uint i : order) add(i, 2);
+  const uint lower_size = size + 1;
+  for (uint k = order.size() - 1; k-- > 0;) add(order[k], lower_size);
+
+  hull.resize(size - 1);
+  return hull;
+}
+
+PlaneBoundary plane_boundary(const std::vector<Eigen::Vector3f>& points,
+                             Plane shape, const std::vector<uint>& indices) {
+  // The detected plane may be the unrefined hypothesis of a few samples
+  shape.refine(points, indices);
+
+  PlaneBoundary boundary;
+  boundary.plane = shape.plane;
+  boundary.number_of_points = indices.size();
+
+  // Coordinates in a basis of the plane, (u, v, normal) is direct so that
+  // the hull is counterclockwise around the normal
+  const Eigen::Vector3f normal = shape.plane.normal();
+  const Eigen::Vector3f u = normal.unitOrthogonal();
+  const Eigen::Vector3f v = normal.cross(u);
+  const Eigen::Vector3f origin = -shape.plane.offset() * normal;
+
+  std::vector<Eigen::Vector2f> projected(indices.size());
+  for (uint k = 0; k < indices.size(); k++) {
+    const Eigen::Vector3f p = points[indices[k]] - origin;
+    projected[k] = {p.dot(u), p.dot(v)};
+  }
+
+  for (uint k : convex_hull(projected))
+    boundary.polygon.push_back(origin + projected[k].x() * u +
+                               projected[k].y() * v);
+  return boundary;
+}
+
+std::vector<PlaneBoundary> plane_boundaries(
+    const std::vector<Eigen::Vector3f>& points, const Detection& detection) {
+  std::vector<const DetectedObject*> planes;
+  for (const DetectedObject& object : detection.objects)
+    if (std::holds_alternative<Plane>(object.shape)) planes.push_back(&object);
+
+  std::vector<PlaneBoundary> boundaries(planes.size());
+  default_thread_pool().parallel_for(
+      planes.size(), 1, [&](uint begin, uint end) {
+        for (uint k = begin; k < end; k++)
+          boundaries[k] =
+              plane_boundary(points, std::get<Plane>(planes[k]->shape),
+                             planes[k]->indices);
+      });
+  return boundaries;
+}
+
+bool save_boundaries_json(const std::string& filename,
+                          const std::vector<PlaneBoundary>& boundaries,
+                          const Eigen::Vector3d& origin) {
+  std::ofstream fs(filename);
+  if (!fs.is_open()) {
+    std::cout << "Error: failed to open output file '" << filename << "'"
+              << std::endl;
+    return false;
+  }
+
+  auto write_vector = [&](const Eigen::Vector3d& v) {
+    fs << '[' << v.x() << ", " << v.y() << ", " << v.z() << ']';
+  };
+
+  // Georeferenced coordinates need more digits
+  fs << std::setprecision(origin.isZero() ? 9 : 12) << "{\"planes\": [";
+  for (uint k = 0; k < boundaries.size(); k++) {
+    const PlaneBoundary& boundary = boundaries[k];
+    fs << (k == 0 ? "\n" : ",\n") << "  {\"normal\": ";
+    const Eigen::Vector3d normal = boundary.plane.normal().cast<double>();
+    write_vector(normal);
+    fs << ", \"offset\": " << boundary.plane.offset() - normal.dot(origin)
+       << ", \"points\": " << boundary.number_of_points << ",\n"
+       << "   \"polygon\": [";
+    for (uint i = 0; i < boundary.polygon.size(); i++) {
+      if (i > 0) fs << ", ";
+      write_vector(boundary.polygon[i].cast<double>() + origin);
+    }
+    fs << "]}";
+  }
+  fs << "\n]}\n";
+
+  if (!fs) {
+    std::cout << "Error: failed to write output file '" << filename << "'"
+              << std::endl;
+    return false;
+  }
+  std::cout << "Saved " << boundaries.size() << " planes to json file '"
+            << filename << "'" << std::endl;
+  return true;
+}
+
+bool can_save_boundaries(const std::string& filename) {
+  const std::string ext = extension(filename);
+  return ext == "obj" || ext == "json";
+}
+
+bool save_boundaries(const std::string& filename,
+                     const std::vector<PlaneBoundary>& boundaries,
+                     const Eigen::Vector3d& origin) {
+  if (!can_save_boundaries(filename)) {
+    std::cout << "Error: boundaries are saved as .obj or .json files, "
+              << "nothing saved to '" << filename << "'" << std::endl;
+    return false;
+  }
+  if (extension(filename) == "json")
+    return save_boundaries_json(filename, boundaries, origin);
+
+  std::vector<Eigen::Vector3f> vertices;
+  std::vector<Eigen::Vector3i> faces;
+  for (const PlaneBoundary& boundary : boundaries) {
+    const int first = vertices.size();
+    vertices.insert(vertices.end(), boundary.polygon.begin(),
+                    boundary.polygon.end());
+    for (int i = first + 1; i + 1 < int(vertices.size()); i++)
+      faces.emplace_back(first, i, i + 1);
+  }
+  return save_obj(filename, vertices, {}, {}, faces, origin);
+}
+
+}  // namespace tnp
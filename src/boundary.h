@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <string>
+#include <vector>
+
+#include "ransac.h"
+
+namespace tnp {
+
+// Compact description of a detected plane: its equation (least squares fit
+// of its inliers) and the outline of its inliers
+struct PlaneBoundary {
+  Eigen::Hyperplane<float, 3> plane;
+  uint number_of_points = 0;  // inliers of the object
+
+  // Convex hull of the inliers projected on the plane, counterclockwise
+  // around the normal of the plane (less than 3 vertices if degenerate)
+  std::vector<Eigen::Vector3f> polygon;
+};
+
+// Indices of the vertices of the convex hull of the points, counterclockwise
+// and without collinear vertices (monotone chain, O(n log n))
+std::vector<uint> convex_hull(const std::vector<Eigen::Vector2f>& points);
+
+// Boundary of each plane of the detection, computed in parallel across the
+// planes on the default thread pool. Other shapes are skipped.
+std::vector<PlaneBoundary> plane_boundaries(
+    const std::vector<Eigen::Vector3f>& points, const Detection& detection);
+
+// Whether save_boundaries supports the extension of filename (.obj or .json)
+bool can_save_boundaries(const std::string& filename);
+
+//
+// Save the boundaries as JSON if the file extension is .json, or as OBJ: the
+// vertices of the polygons and a fan of triangles per polygon. Other
+// extensions are an error. The boundaries are translated by origin (e.g. the
+// offset of a LAS file).
+//
+// JSON example:
+//     {"planes": [
+//       {"normal": [0, 0, 1], "offset": -2, "points": 20000,
+//        "polygon": [[0, 0, 2], [5, 0, 2], [5, 4, 2], [0, 4, 2]]}
+//     ]}
+//
+bool save_boundaries(const std::string& filename,
+                     const std::vector<PlaneBoundary>& boundaries,
+                     const Eigen::Vector3d& origin = Eigen::Vector3d::Zero());
+
+}  // namespace tnp
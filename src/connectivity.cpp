@@ -0,0 +1,72 @@
+#include "connectivity.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace tnp {
+
+// Union-find with path halving and union by size
+struct DisjointSets {
+  std::vector<uint> parent;
+  std::vector<uint> size;
+
+  explicit DisjointSets(uint n) : parent(n), size(n, 1) {
+    std::iota(parent.begin(), parent.end(), 0);
+  }
+
+  uint find(uint i) {
+    while (parent[i] != i) {
+      parent[i] = parent[parent[i]];
+      i = parent[i];
+    }
+    return i;
+  }
+
+  void unite(uint a, uint b) {
+    a = find(a);
+    b = find(b);
+    if (a == b) return;
+    if (size[a] < size[b]) std::swap(a, b);
+    parent[b] = a;
+    size[a] += size[b];
+  }
+};
+
+std::vector<std::vector<uint>> connected_components(
+    const std::vector<Eigen::Vector3f>& points, const KdTree& kdtree,
+    const std::vector<uint>& indices, const float radius,
+    std::vector<int>& slots) {
+  // Position of each point of indices, -1 for the points outside of it
+  for (uint k = 0; k < indices.size(); k++) slots[indices[k]] = k;
+
+  DisjointSets sets(indices.size());
+  for (uint k = 0; k < indices.size(); k++) {
+    // Each pair is united once, from its lowest slot
+    kdtree.for_each_neighbors(points, points[indices[k]], radius, [&](int i) {
+      if (slots[i] > int(k)) sets.unite(k, slots[i]);
+    });
+  }
+
+  for (uint i : indices) slots[i] = -1;
+
+  // Gather the points of each root
+  std::vector<int> component_of_root(indices.size(), -1);
+  std::vector<std::vector<uint>> components;
+  for (uint k = 0; k < indices.size(); k++) {
+    const uint root = sets.find(k);
+    if (component_of_root[root] < 0) {
+      component_of_root[root] = components.size();
+      components.emplace_back();
+      components.back().reserve(sets.size[root]);
+    }
+    components[component_of_root[root]].push_back(indices[k]);
+  }
+
+  std::stable_sort(components.begin(), components.end(),
+                   [](const std::vector<uint>& a, const std::vector<uint>& b) {
+                     return a.size() > b.size();
+                   });
+  return components;
+}
+
+}  // namespace tnp
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <vector>
+
+#include "kdtree.h"
+
+namespace tnp {
+
+// Split the points at the given indices into spatially connected components:
+// two points are connected if they are closer than radius.
+// kdtree must be built on points, neighbors that are not in indices are
+// ignored. slots must have points.size() elements set to -1, they are reset
+// before returning so that it can be reused without a full clear.
+// Components are sorted by decreasing size.
+std::vector<std::vector<uint>> connected_components(
+    const std::vector<Eigen::Vector3f>& points, const KdTree& kdtree,
+    const std::vector<uint>& indices, const float radius,
+    std::vector<int>& slots);
+
+}  // namespace tnp
@@ -0,0 +1,65 @@
+#include <io.h>
+#include <las.h>
+#include <obj.h>
+#include <ply.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace tnp {
+
+// lower case extension of filename (without the dot)
+std::string extension(const std::string& filename)
+{
+    const auto dot = filename.find_last_of('.');
+    if(dot == std::string::npos)
+        return "";
+    auto ext = filename.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+bool load_cloud(
+    const std::string& filename,
+    std::vector<Eigen::Vector3f>& points,
+    std::vector<Eigen::Vector3f>& normals,
+    std::vector<Eigen::Vector3f>& colors,
+    Eigen::Vector3d* origin)
+{
+    if(origin != nullptr)
+        origin->setZero();
+
+    const auto ext = extension(filename);
+    if(ext == "ply")
+        return load_ply(filename, points, normals, colors);
+    if(ext == "las")
+    {
+        normals.clear();
+        return load_las(filename, points, colors, origin);
+    }
+    return load_obj(filename, points, normals, colors);
+}
+
+bool save_cloud(
+    const std::string& filename,
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>& normals,
+    const std::vector<Eigen::Vector3f>& colors,
+    const Eigen::Vector3d& origin)
+{
+    const auto ext = extension(filename);
+    if(ext == "ply")
+        return save_ply(filename, points, normals, colors, origin);
+    if(ext == "las")
+    {
+        std::cout << "Error: "
+            << "saving las files is not supported, nothing saved to '"
+            << filename
+            << "'"
+            << std::endl;
+        return false;
+    }
+    return save_obj(filename, points, normals, colors, {}, origin);
+}
+
+} // namespace tnp
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <string>
+#include <vector>
+
+namespace tnp {
+
+// lower case extension of filename (without the dot), empty if none
+std::string extension(const std::string& filename);
+
+//
+// Load or save a point cloud in the format given by the file extension:
+// .obj (ascii), .ply (binary) or .las (load only, uncompressed)
+// the points of a las file are relative to its offset, stored in origin if
+// not nullptr (zero for the other formats), saving adds origin back to the
+// points
+//
+bool load_cloud(
+    const std::string& filename,
+    std::vector<Eigen::Vector3f>& points,
+    std::vector<Eigen::Vector3f>& normals,
+    std::vector<Eigen::Vector3f>& colors,
+    Eigen::Vector3d* origin = nullptr);
+
+bool save_cloud(
+    const std::string& filename,
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>& normals,
+    const std::vector<Eigen::Vector3f>& colors,
+    const Eigen::Vector3d& origin = Eigen::Vector3d::Zero());
+
+} // namespace tnp
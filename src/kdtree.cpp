@@ -1,11 +1,15 @@
 #include <kdtree.h>
+#include <thread_pool.h>
+
+#include <cmath>
 #include <stack>
 
 namespace tnp {
 
 KdTree::~KdTree()
 {
-    this->delete_rec(m_root);
+    if(m_root != nullptr)
+        this->delete_rec(m_root);
 }
 
 
@@ -17,8 +21,29 @@ void KdTree::build(const std::vector<Eigen::Vector3f>& points)
     std::iota(m_indices.begin(), m_indices.end(), 0);
 
     // allocate root node and recursively build the tree
+    if(m_root != nullptr)
+        this->delete_rec(m_root);
     m_root = new Node();
-    this->build_rec(points, m_indices.begin(), m_indices.end(), m_root);
+
+    // small clouds are built serially
+    ThreadPool& pool = default_thread_pool();
+    if(pool.size() == 1 or points.size() < parallel_build_min_points)
+    {
+        this->build_rec(points, m_indices.begin(), m_indices.end(), m_root);
+        return;
+    }
+
+    // the top of the tree is built serially until there are a few subtrees
+    // per thread, the subtrees are then built in parallel
+    const int depth = std::ceil(std::log2(4 * pool.size()));
+    std::vector<Subtree> subtrees;
+    this->build_rec(points, m_indices.begin(), m_indices.end(), m_root, depth, &subtrees);
+
+    pool.parallel_for(subtrees.size(), 1, [&](uint begin, uint end)
+    {
+        for(auto i = begin; i < end; ++i)
+            this->build_rec(points, subtrees[i].begin, subtrees[i].end, subtrees[i].node);
+    });
 }
 
 
@@ -30,11 +55,19 @@ void KdTree::build_rec(
     const std::vector<Eigen::Vector3f>& points, // point cloud
     iterator begin,                             // begin iterator over the current points indices
     iterator end,                               // end iterator over the current points indices
-    Node* node)                                 // node to fill 
+    Node* node,                                 // node to fill 
+    int depth,                                  // depth left before deferring the subtrees
+    std::vector<Subtree>* subtrees)             // deferred subtrees
 {
     assert(node != nullptr);
     assert(begin <= end);
 
+    if(subtrees != nullptr and depth == 0)
+    {
+        subtrees->push_back({begin, end, node});
+        return;
+    }
+
     // step 1.1
 
     if(end - begin <= max_number_point_per_leaf)
@@ -73,8 +106,8 @@ void KdTree::build_rec(
         node->left_child = new Node();
         node->right_child = new Node();
 
-        this->build_rec(points, begin, it_cut, node->left_child);
-        this->build_rec(points, it_cut, end, node->right_child);
+        this->build_rec(points, begin, it_cut, node->left_child, depth - 1, subtrees);
+        this->build_rec(points, it_cut, end, node->right_child, depth - 1, subtrees);
     }
 }
 
@@ -3,6 +3,7 @@
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
+#include <functional>
 #include <numeric>
 #include <iostream>
 #include <vector>
@@ -56,6 +57,11 @@ struct Node
 //
 constexpr auto max_number_point_per_leaf = 25;
 
+//
+// clouds with less points are built by a single thread
+//
+constexpr auto parallel_build_min_points = 1u << 16;
+
 //
 // 3D binary search tree recursively cutting in half 
 // along the dimension where points spread the most
@@ -64,6 +70,8 @@ class KdTree
 {
 public:
     KdTree() = default;
+    KdTree(const KdTree&) = delete;
+    KdTree& operator=(const KdTree&) = delete;
     ~KdTree();
 
 public:
@@ -87,21 +95,33 @@ public:
         Func f) const;                              // function to called on resulting indices
 
 private:
+    // subtree left to build by build_rec
+    struct Subtree
+    {
+        iterator begin;
+        iterator end;
+        Node* node;
+    };
+
     // recursively build the tree
     // consider points at indices in the range (begin,end(
     // node is already allocated and must be filled
     // points are not changed
+    // if subtrees is not nullptr, the nodes at the given depth are not built
+    // but added to subtrees (so that they can be built in parallel)
     void build_rec(
         const std::vector<Eigen::Vector3f>& points, // point cloud
         iterator begin,                             // begin iterator over the current points indices
         iterator end,                               // end iterator over the current points indices
-        Node* node);                                // node to fill
+        Node* node,                                 // node to fill
+        int depth = 0,                              // depth left before deferring the subtrees
+        std::vector<Subtree>* subtrees = nullptr);  // deferred subtrees
 
     // recursively delete nodes
     void delete_rec(Node* node);
 
 public:
-    Node* m_root;               // root node of the tree
+    Node* m_root = nullptr;     // root node of the tree
     std::vector<int> m_indices; // vector of unique indices that references the points
 };
 
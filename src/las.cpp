@@ -0,0 +1,171 @@
+#include <las.h>
+#include <mapped_file.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace tnp {
+
+// LAS files are little endian
+template<typename T>
+T read_las(const char* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+// offset of the RGB channels in a point record, -1 if the format has no colors
+int las_color_offset(int format)
+{
+    switch(format)
+    {
+    case 2:  return 20;
+    case 3:
+    case 5:  return 28;
+    case 7:
+    case 8:
+    case 10: return 30;
+    default: return -1;
+    }
+}
+
+// minimum length of a point record of the format, from the LAS specification
+int las_record_size(int format)
+{
+    static const int sizes[] = {20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67};
+    return sizes[format];
+}
+
+bool load_las(
+    const std::string& filename,
+    std::vector<Eigen::Vector3f>& points,
+    std::vector<Eigen::Vector3f>& colors,
+    Eigen::Vector3d* origin)
+{
+    points.clear();
+    colors.clear();
+
+    MappedFile file;
+    if(not file.open(filename))
+    {
+        std::cout << "Error: "
+            << "failed to open input las file '"
+            << filename
+            << "', file not found, nothing loaded"
+            << std::endl;
+        return false;
+    }
+
+    // public header block -----------------------------------------------------
+    const char* data = file.data();
+    if(file.size() < 227 or std::strncmp(data, "LASF", 4) != 0)
+    {
+        std::cout << "Error: "
+            << "input file '"
+            << filename
+            << "' is not a las file, nothing loaded"
+            << std::endl;
+        return false;
+    }
+
+    const auto version_major = read_las<uint8_t>(data + 24);
+    const auto version_minor = read_las<uint8_t>(data + 25);
+    const auto header_size = read_las<uint16_t>(data + 94);
+    if(header_size < 227 or file.size() < header_size)
+    {
+        std::cout << "Error: "
+            << "invalid header size "
+            << header_size
+            << " of input las file '"
+            << filename
+            << "', nothing loaded"
+            << std::endl;
+        return false;
+    }
+    const auto offset_to_points = read_las<uint32_t>(data + 96);
+    const auto format_id = read_las<uint8_t>(data + 104);
+    const auto record_length = read_las<uint16_t>(data + 105);
+    uint64_t count = read_las<uint32_t>(data + 107);
+    const Eigen::Vector3d scale(
+        read_las<double>(data + 131),
+        read_las<double>(data + 139),
+        read_las<double>(data + 147));
+    const Eigen::Vector3d offset(
+        read_las<double>(data + 155),
+        read_las<double>(data + 163),
+        read_las<double>(data + 171));
+
+    // LAS 1.4 stores the 64 bits number of points after the legacy fields
+    if(version_major == 1 and version_minor >= 4 and header_size >= 375 and count == 0)
+        count = read_las<uint64_t>(data + 247);
+
+    // LAZ sets the 2 high bits of the format id
+    const auto format = format_id & 0x3f;
+    if((format_id & 0xc0) != 0 or format > 10)
+    {
+        std::cout << "Error: "
+            << "unsupported point data format "
+            << int(format_id)
+            << " of input las file '"
+            << filename
+            << "' (compressed las is not supported), nothing loaded"
+            << std::endl;
+        return false;
+    }
+    if(record_length < las_record_size(format))
+    {
+        std::cout << "Error: "
+            << "point record length "
+            << record_length
+            << " of input las file '"
+            << filename
+            << "' is too short for point data format "
+            << format
+            << ", nothing loaded"
+            << std::endl;
+        return false;
+    }
+    if(offset_to_points + count * record_length > file.size())
+    {
+        std::cout << "Error: "
+            << "failed to read the "
+            << count
+            << " points of input las file '"
+            << filename
+            << "', file truncated, nothing loaded"
+            << std::endl;
+        return false;
+    }
+
+    if(origin != nullptr)
+        *origin = offset;
+
+    // point data records ------------------------------------------------------
+    const auto color_offset = las_color_offset(format);
+    points.resize(count);
+    if(color_offset >= 0)
+        colors.resize(count);
+
+    const char* records = data + offset_to_points;
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        const char* record = records + i * record_length;
+        for(auto d = 0; d < 3; ++d)
+            points[i][d] = read_las<int32_t>(record + 4 * d) * scale[d];
+        if(color_offset >= 0)
+            for(auto d = 0; d < 3; ++d)
+                colors[i][d] = read_las<uint16_t>(record + color_offset + 2 * d) / 65535.f;
+    }
+
+    std::cout << "Loaded "
+        << points.size()
+        << " points from las file '" << filename << "'";
+    if(not colors.empty())
+        std::cout << " (with colors)";
+    std::cout << std::endl;
+    return points.size() > 0;
+}
+
+} // namespace tnp
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <string>
+#include <vector>
+
+namespace tnp {
+
+//
+// Uncompressed LAS 1.2 to 1.4 files (point data record formats 0 to 10)
+// points are scaled as given by the header but stay relative to its offset
+// (stored in origin if not nullptr) since georeferenced coordinates do not fit
+// in a float, RGB colors (formats 2, 3, 5, 7, 8 and 10) are divided by 65535,
+// LAS files have no normals
+//
+bool load_las(
+    const std::string& filename,
+    std::vector<Eigen::Vector3f>& points,
+    std::vector<Eigen::Vector3f>& colors,
+    Eigen::Vector3d* origin = nullptr);
+
+} // namespace tnp
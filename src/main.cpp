@@ -1,10 +1,29 @@
+#include <io.h>
 #include <kdtree.h>
 #include <obj.h>
 
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <set>
+
+#include "boundary.h"
+#include "pipeline.h"
 #include "ransac.h"
+#include "server.h"
+#include "spatial_sort.h"
+#include "sweep.h"
+#include "thread_pool.h"
 
 using namespace tnp;
 
+// Options that do not take a value
+const std::set<std::string> FLAGS{"--keep-all-components", "--quantize",
+                                  "--pin-threads", "--sequence",
+                                  "--batch", "--cache-bitsets", "--morton",
+                                  "--oriented", "--boundaries"};
+
 std::vector<Eigen::Vector3f> COLORS{{255. / 255., 179. / 255., 0. / 255.},
                                     {128. / 255., 62. / 255., 117. / 255.},
                                     {255. / 255., 104. / 255., 0. / 255.},
@@ -26,8 +45,9 @@ std::vector<Eigen::Vector3f> COLORS{{255. / 255., 179. / 255., 0. / 255.},
                                     {241. / 255., 58. / 255., 19. / 255.},
                                     {35. / 255., 44. / 255., 22. / 255.}};
 
-void coloring_and_save(std::string filename,
-                       std::vector<std::vector<Eigen::Vector3f>> objects) {
+bool coloring_and_save(std::string filename,
+                       std::vector<std::vector<Eigen::Vector3f>> objects,
+                       const Eigen::Vector3d& origin) {
   std::vector<Eigen::Vector3f> points;
   std::vector<Eigen::Vector3f> colors;
 
@@ -41,35 +61,58 @@ void coloring_and_save(std::string filename,
     color_idx = (color_idx + 1) % COLORS.size();
   }
 
-  save_obj(filename, points, {}, colors);
+  if (!save_cloud(filename, points, {}, colors, origin)) return false;
 
   std::cout << "Saved " << objects.size() << " objects." << std::endl;
+  return true;
 }
 
+// Point cloud going through the load, detect and save stages
+struct Frame {
+  uint index = 0;
+  std::vector<Eigen::Vector3f> points;
+  std::vector<Eigen::Vector3f> normals;
+  std::vector<Eigen::Vector3f> colors;
+  Eigen::Vector3d origin;  // of the coordinates, added back when saving
+  std::unique_ptr<SharedIndex> search_index;  // built by the load stage
+  std::vector<std::vector<Eigen::Vector3f>> objects;
+  std::vector<PlaneBoundary> boundaries;  // instead of objects
+};
+
 int main(int argc, char* argv[]) {
   // option -----------------------------------------------------------------
-  if (argc <= 1) {
-    std::cout << "Error: missing filename" << std::endl;
-    return 1;
+  // positional arguments and "--name [value]" options can be mixed
+  std::vector<std::string> args;
+  std::map<std::string, std::string> options;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg.rfind("--", 0) != 0) {
+      args.push_back(arg);
+    } else if (FLAGS.count(arg)) {
+      options[arg] = "";
+    } else if (i + 1 < argc) {
+      options[arg] = argv[++i];
+    } else {
+      std::cout << "Error: missing value for option '" << arg << "'"
+                << std::endl;
+      return 1;
+    }
   }
-  const auto filename = std::string(argv[1]);
 
-  // load -------------------------------------------------------------------
-  auto points = std::vector<Eigen::Vector3f>();
-  auto normals_buffer = std::vector<Eigen::Vector3f>();
-  if (not tnp::load_obj(filename, points, normals_buffer)) {
-    std::cout << "Error: failed to open input file '" << filename << "'"
-              << std::endl;
+  // With --server, the filename is not used (it may be omitted), the other
+  // arguments and the options give the default parameters of the requests
+  const bool server = options.count("--server");
+  if (args.empty() && !server) {
+    std::cout << "Error: missing filename" << std::endl;
     return 1;
   }
+  const auto filename = args.empty() ? std::string() : args[0];
 
-  std::optional<std::vector<Eigen::Vector3f>> normals;
-  
-  if (!normals_buffer.empty()) {
-    // Normalize the normals
-    for (auto& n : normals_buffer) n.normalize();
-
-    normals = normals_buffer;
+  // threads ----------------------------------------------------------------
+  if (options.count("--threads") || options.count("--pin-threads")) {
+    uint threads = 0;
+    if (options.count("--threads")) threads = std::stoi(options["--threads"]);
+    set_default_thread_pool(threads, options.count("--pin-threads"));
   }
 
   // process ----------------------------------------------------------------
@@ -77,18 +120,226 @@ int main(int argc, char* argv[]) {
   const uint max_number_of_iterations = 1000;
 
   int max_objects = 5;
-  if (argc >= 3)
-    max_objects = std::stoi(argv[2]);
+  if (args.size() >= 2)
+    max_objects = std::stoi(args[1]);
 
   float min_inliers_ratio = 0.05;
-  if (argc >= 4)
-    min_inliers_ratio = std::stof(argv[3]);
+  if (args.size() >= 3)
+    min_inliers_ratio = std::stof(args[2]);
 
-  std::vector<std::vector<Eigen::Vector3f>> objects =
-      ransac_multi(points, threshold, max_number_of_iterations, max_objects,
-                   min_inliers_ratio, normals);
+  uint shapes = PLANE;
+  if (args.size() >= 4) {
+    shapes = parse_shapes(args[3]);
+    if (shapes == 0) {
+      std::cout << "Error: unknown shapes '" << args[3]
+                << "', expected a comma separated list of plane, sphere "
+                   "and cylinder"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  RansacParams params;
+  params.threshold = threshold;
+  params.max_number_of_iterations = max_number_of_iterations;
+  params.max_objects = max_objects;
+  params.min_inliers_ratio = min_inliers_ratio;
+  params.shapes = shapes;
+
+  if (options.count("--scoring") &&
+      !parse_scoring(options["--scoring"], params.scoring)) {
+    std::cout << "Error: unknown scoring '" << options["--scoring"]
+              << "', expected count, msac or magsac" << std::endl;
+    return 1;
+  }
+  params.oriented_normals = options.count("--oriented");
+  if (options.count("--max-radius"))
+    params.max_radius = std::stof(options["--max-radius"]);
+  if (options.count("--connectivity"))
+    params.connectivity_radius = std::stof(options["--connectivity"]);
+  params.keep_all_components = options.count("--keep-all-components");
+  if (options.count("--voxel-size"))
+    params.voxel_size = std::stof(options["--voxel-size"]);
+  if (options.count("--pyramid-levels"))
+    params.pyramid_levels = std::stoi(options["--pyramid-levels"]);
+  if (options.count("--pyramid-factor")) {
+    const int factor = std::stoi(options["--pyramid-factor"]);
+    if (factor < 2) {
+      std::cout << "Error: pyramid factor must be at least 2, got " << factor
+                << std::endl;
+      return 1;
+    }
+    params.pyramid_factor = factor;
+  }
+  params.quantize = options.count("--quantize");
+  if (options.count("--normal-bins"))
+    params.normal_bins = std::stoi(options["--normal-bins"]);
+  if (options.count("--hypothesis-cache"))
+    params.hypothesis_cache_size = std::stoi(options["--hypothesis-cache"]);
+  params.cache_bitsets = options.count("--cache-bitsets");
+
+  // With --server, detection requests are answered until a quit request
+  if (server) {
+    uint cache_size = 4;
+    if (options.count("--cache-size"))
+      cache_size = std::stoi(options["--cache-size"]);
+    return run_server(options["--server"], params, cache_size) ? 0 : 1;
+  }
+
+  std::string output = "../data/multi_ransac.obj";
+  if (options.count("--output")) output = options["--output"];
+
+  // With --boundaries, each plane is saved as its equation and the convex
+  // hull of its inliers instead of the points of every object
+  const bool boundaries = options.count("--boundaries");
+  if (boundaries && !can_save_boundaries(output)) {
+    std::cout << "Error: with --boundaries, the output file must be a .obj "
+              << "or .json file, got '" << output << "'" << std::endl;
+    return 1;
+  }
 
-  coloring_and_save("../data/multi_ransac.obj", objects);
+  // With --sequence or --batch, the file lists the frames (one file per
+  // line), each one saved to the output file name followed by its index.
+  // Frames of a sequence start from the shapes of the previous one.
+  std::vector<std::string> frames{filename};
+  const bool sequence = options.count("--sequence");
+  const bool batch = options.count("--batch");
+  if (sequence || batch) {
+    std::ifstream list(filename);
+    if (!list.is_open()) {
+      std::cout << "Error: failed to open frames list '" << filename << "'"
+                << std::endl;
+      return 1;
+    }
+    frames.clear();
+    for (std::string frame; std::getline(list, frame);)
+      if (!frame.empty()) frames.push_back(frame);
+  }
+  // Warm start only makes sense across the frames of a sequence, the
+  // configurations of a sweep are independent
+  params.warm_start = sequence && !options.count("--sweep");
+
+  // With --sweep, every configuration of the sweep file runs on the point
+  // cloud and the table of results is printed (or saved to the output file)
+  if (options.count("--sweep")) {
+    std::vector<RansacParams> configurations;
+    if (!load_sweep(options["--sweep"], params, configurations)) return 1;
+
+    auto points = std::vector<Eigen::Vector3f>();
+    auto normals = std::vector<Eigen::Vector3f>();
+    auto colors = std::vector<Eigen::Vector3f>();
+    if (not tnp::load_cloud(filename, points, normals, colors)) {
+      std::cout << "Error: failed to open input file '" << filename << "'"
+                << std::endl;
+      return 1;
+    }
+    for (auto& n : normals) n.normalize();
+    if (options.count("--morton")) morton_sort(points, normals, colors);
+
+    const std::vector<SweepResult> results = sweep(
+        points, normals.empty() ? nullptr : &normals, configurations);
+
+    if (!options.count("--output")) {
+      write_sweep_table(std::cout, results, points.size());
+      return 0;
+    }
+    std::ofstream table(output);
+    if (!table.is_open()) {
+      std::cout << "Error: failed to open output file '" << output << "'"
+                << std::endl;
+      return 1;
+    }
+    write_sweep_table(table, results, points.size());
+    std::cout << "Saved " << results.size() << " configurations."
+              << std::endl;
+    return 0;
+  }
+
+  // Frames are pipelined: the next frame is loaded (and its search
+  // structures built) and the previous one saved while detecting on a frame.
+  // At most --queue-size frames wait between two stages.
+  uint queue_size = 2;
+  if (options.count("--queue-size"))
+    queue_size = std::stoi(options["--queue-size"]);
+
+  // load -------------------------------------------------------------------
+  auto load = [&](uint index, Frame& frame) {
+    frame.index = index;
+    if (not tnp::load_cloud(frames[index], frame.points, frame.normals,
+                            frame.colors, &frame.origin)) {
+      std::cout << "Error: failed to open input file '" << frames[index]
+                << "'" << std::endl;
+      return false;
+    }
+
+    // Normalize the normals
+    for (auto& n : frame.normals) n.normalize();
+
+    // The objects are saved as lists of points, the order of the points in
+    // the input does not need to be restored
+    if (options.count("--morton"))
+      morton_sort(frame.points, frame.normals, frame.colors);
+
+    frame.search_index = std::make_unique<SharedIndex>();
+    frame.search_index->build(
+        frame.points, frame.normals.empty() ? nullptr : &frame.normals,
+        params);
+    return true;
+  };
+
+  // detect -----------------------------------------------------------------
+  RansacWorkspace workspace(std::rand());
+  Detection detection;
+  auto detect = [&](Frame& frame) {
+    const auto start = std::chrono::steady_clock::now();
+    workspace.shared_index = frame.search_index.get();
+    ransac_multi(frame.points,
+                 frame.normals.empty() ? nullptr : &frame.normals, params,
+                 workspace, detection);
+    workspace.shared_index = nullptr;
+    const std::chrono::duration<double, std::milli> duration =
+        std::chrono::steady_clock::now() - start;
+
+    for (const DetectedObject& object : detection.objects)
+      std::cout << "Detected " << shape_name(object.shape) << " with "
+                << object.indices.size() << " points." << std::endl;
+    if (sequence || batch)
+      std::cout << "Frame " << frame.index << " processed in "
+                << duration.count() << " ms." << std::endl;
+
+    // Only the objects (or their boundaries) are kept until the frame is
+    // saved
+    if (boundaries)
+      frame.boundaries = plane_boundaries(frame.points, detection);
+    else
+      frame.objects = split_objects(frame.points, detection);
+    frame.points = {};
+    frame.normals = {};
+    frame.colors = {};
+    frame.search_index.reset();
+    return true;
+  };
+
+  // save -------------------------------------------------------------------
+  auto save = [&](Frame& frame) {
+    std::string frame_output = output;
+    if (sequence || batch) {
+      auto dot = output.find_last_of('.');
+      const auto slash = output.find_last_of('/');
+      if (slash != std::string::npos && dot < slash) dot = std::string::npos;
+      frame_output = output.substr(0, dot) + "_" + std::to_string(frame.index);
+      if (dot != std::string::npos) frame_output += output.substr(dot);
+    }
+    if (boundaries)
+      return save_boundaries(frame_output, frame.boundaries, frame.origin);
+    return coloring_and_save(frame_output, frame.objects, frame.origin);
+  };
+
+  // The point clouds of a batch are independent, one that fails does not
+  // stop the others
+  if (!run_pipeline<Frame>(frames.size(), queue_size, load, detect, save,
+                           !batch))
+    return 1;
 
   return 0;
 }
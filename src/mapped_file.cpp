@@ -0,0 +1,51 @@
+#include <mapped_file.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tnp {
+
+MappedFile::~MappedFile()
+{
+    this->close();
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+    this->close();
+
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat status;
+    if(fstat(fd, &status) != 0 or status.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference to the file
+    if(data == MAP_FAILED)
+        return false;
+
+    // the file is read once from the beginning to the end
+    madvise(data, status.st_size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const char*>(data);
+    m_size = status.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(m_data != nullptr)
+        munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+
+} // namespace tnp
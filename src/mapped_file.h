@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace tnp {
+
+//
+// Read-only memory mapping of a whole file
+//
+// Example:
+//     MappedFile file;
+//     if(file.open("cloud.ply"))
+//         parse(file.data(), file.size());
+//
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+public:
+    // map the file, return false if it cannot be opened or mapped
+    bool open(const std::string& filename);
+
+    // unmap the file
+    void close();
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+} // namespace tnp
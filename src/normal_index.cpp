@@ -0,0 +1,107 @@
+#include "normal_index.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+
+namespace tnp {
+
+// Added to the radius of the bins so that rounding errors never skip a bin
+// holding an aligned normal (in radians)
+constexpr float RADIUS_MARGIN = 1e-3;
+
+constexpr float HALF_PI = 1.57079632679f;
+
+// Fold the lower hemisphere of the octahedron onto the upper one
+Eigen::Vector2f fold_octahedral(const Eigen::Vector2f& v) {
+  return {(1 - std::abs(v.y())) * (v.x() >= 0 ? 1.f : -1.f),
+          (1 - std::abs(v.x())) * (v.y() >= 0 ? 1.f : -1.f)};
+}
+
+Eigen::Vector2f octahedral_coordinates(const Eigen::Vector3f& normal) {
+  const float l1 = normal.cwiseAbs().sum();
+  if (l1 == 0) return Eigen::Vector2f::Zero();
+
+  const Eigen::Vector2f v = normal.head<2>() / l1;
+  return normal.z() < 0 ? fold_octahedral(v) : v;
+}
+
+// Cell of the normal on the octahedral map
+uint bin_of(const Eigen::Vector3f& normal, const uint resolution) {
+  const Eigen::Vector2f v = octahedral_coordinates(normal);
+  const auto cell = [&](float x) {
+    return std::min<uint>(resolution - 1,
+                          uint(std::max(0.f, (x + 1) / 2 * resolution)));
+  };
+  return cell(v.x()) * resolution + cell(v.y());
+}
+
+void NormalIndex::build(const std::vector<Eigen::Vector3f>& points,
+                        const std::vector<Eigen::Vector3f>& normals,
+                        uint resolution) {
+  resolution = std::max(1u, resolution);
+  const uint size = points.size();
+  const uint number_of_bins = resolution * resolution;
+
+  // Counting sort of the points by bin
+  offsets.assign(number_of_bins + 1, 0);
+  for (uint i = 0; i < size; i++)
+    offsets[bin_of(normals[i], resolution) + 1]++;
+  for (uint b = 0; b < number_of_bins; b++) offsets[b + 1] += offsets[b];
+
+  this->points.resize(size);
+  this->normals.resize(size);
+  indices.resize(size);
+  // offsets[b] is moved to the end of bin b while it is filled, then shifted
+  // back, so that nothing is allocated
+  for (uint i = 0; i < size; i++) {
+    const uint position = offsets[bin_of(normals[i], resolution)]++;
+    this->points[position] = points[i];
+    this->normals[position] = normals[i];
+    indices[position] = i;
+  }
+  for (uint b = number_of_bins; b > 0; b--) offsets[b] = offsets[b - 1];
+  offsets[0] = 0;
+
+  directions.resize(number_of_bins);
+  radii.resize(number_of_bins);
+  for (uint b = 0; b < number_of_bins; b++) {
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    for (uint i = offsets[b]; i < offsets[b + 1]; i++)
+      sum += this->normals[i].normalized();
+
+    // Zero normals (or a zero mean) are aligned with nothing, such a bin is
+    // always visited
+    if (sum.isZero()) {
+      directions[b] = Eigen::Vector3f::UnitZ();
+      radii[b] = offsets[b] == offsets[b + 1] ? 0 : 2 * HALF_PI;
+      continue;
+    }
+    directions[b] = sum.normalized();
+
+    float min_cosine = 1;
+    for (uint i = offsets[b]; i < offsets[b + 1]; i++) {
+      const Eigen::Vector3f& normal = this->normals[i];
+      min_cosine = std::min(
+          min_cosine,
+          normal.isZero(0) ? -1.f : directions[b].dot(normal.normalized()));
+    }
+    radii[b] = std::acos(std::clamp(min_cosine, -1.f, 1.f)) + RADIUS_MARGIN;
+  }
+}
+
+bool NormalIndex::may_align(const uint b, const Eigen::Vector3f& direction,
+                            const float max_angle) const {
+  const float angle = max_angle + radii[b];
+  if (angle >= HALF_PI) return true;
+  return std::abs(direction.dot(directions[b])) >= std::cos(angle);
+}
+
+bool NormalIndex::may_face(const uint b, const Eigen::Vector3f& direction,
+                           const float max_angle) const {
+  const float angle = max_angle + radii[b];
+  if (angle >= 2 * HALF_PI) return true;
+  return direction.dot(directions[b]) >= std::cos(angle);
+}
+
+}  // namespace tnp
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace tnp {
+
+// Coordinates in [-1, 1]^2 of a normal on the octahedral map of the sphere
+// (the lower hemisphere is folded onto the corners), (0, 0) for a zero normal
+Eigen::Vector2f octahedral_coordinates(const Eigen::Vector3f& normal);
+
+//
+// Points binned by the direction of their normal on a Gauss sphere grid: the
+// resolution x resolution cells of the octahedral map of the sphere. Points
+// and normals are copied in bin order so that each bin is contiguous.
+//
+// Every bin keeps the mean direction of its normals and the largest angle
+// between this direction and them, so that the bins without any normal close
+// enough to a direction (or to its opposite) are skipped, e.g. the points
+// that cannot be inliers of a plane because their normal is not aligned.
+//
+struct NormalIndex {
+  std::vector<uint> offsets;  // bin b holds [offsets[b], offsets[b + 1])
+  std::vector<Eigen::Vector3f> directions;  // unit mean normal of each bin
+  std::vector<float> radii;  // largest angle to the direction in each bin
+  std::vector<Eigen::Vector3f> points;
+  std::vector<Eigen::Vector3f> normals;
+  std::vector<uint> indices;  // index in the input of each binned point
+
+  // Bin the points by their normal (normals should be normalized)
+  void build(const std::vector<Eigen::Vector3f>& points,
+             const std::vector<Eigen::Vector3f>& normals,
+             const uint resolution);
+
+  uint bins() const { return directions.size(); }
+  uint size() const { return points.size(); }
+
+  // Whether bin b may hold a normal within max_angle of the unit direction
+  // or of its opposite
+  bool may_align(const uint b, const Eigen::Vector3f& direction,
+                 const float max_angle) const;
+
+  // Whether bin b may hold a normal within max_angle of the unit direction
+  bool may_face(const uint b, const Eigen::Vector3f& direction,
+                const float max_angle) const;
+};
+
+}  // namespace tnp
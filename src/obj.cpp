@@ -1,7 +1,13 @@
+#include <mapped_file.h>
 #include <obj.h>
+#include <thread_pool.h>
 
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <utility>
 
 namespace tnp {
 
@@ -40,6 +46,118 @@ bool load_obj(
     return load_obj(filename, points, normals, colors);
 }
 
+// points, normals and colors of a range of lines of an obj file
+struct ObjChunk
+{
+    const char* begin;          // first character of the chunk
+    const char* end;            // past-the-end character
+    int first_line = 0;         // index of the first line in the file
+    std::vector<Eigen::Vector3f> points;
+    std::vector<Eigen::Vector3f> normals;
+    std::vector<Eigen::Vector3f> colors;
+    std::ostringstream warnings; // printed in order once every chunk is read
+};
+
+// files smaller than this are read by a single thread
+constexpr std::size_t parallel_obj_min_size = 1 << 20;
+
+void parse_obj_line(
+    const std::string& filename,
+    const std::string& line,
+    int idx_line,
+    ObjChunk& chunk)
+{
+    const auto tokens = split(line);
+    if(line.empty() or tokens.empty()) 
+    {
+        // empty line
+        // nothing to do
+    }
+    else if(line.front() == '#')
+    {
+        // comment = "# ..."
+        // nothing to do
+    }
+    else if(tokens.front() == "v")
+    {
+        // line = "v x y z"
+        // or line = "v x y z r g b"
+        if(tokens.size() == 4)
+        {
+            chunk.points.push_back(Eigen::Vector3f{
+                std::stof(tokens[1]),
+                std::stof(tokens[2]),
+                std::stof(tokens[3])
+            });
+        }
+        else if(tokens.size() == 7)
+        {
+            // both are read before adding any, a line is read entirely or
+            // not at all
+            const Eigen::Vector3f point{
+                std::stof(tokens[1]),
+                std::stof(tokens[2]),
+                std::stof(tokens[3])
+            };
+            const Eigen::Vector3f color{
+                std::stof(tokens[4]),
+                std::stof(tokens[5]),
+                std::stof(tokens[6])
+            };
+            chunk.points.push_back(point);
+            chunk.colors.push_back(color);
+        }
+        else
+        {
+            chunk.warnings << "Warning: "
+                << "failed to read line " 
+                << idx_line 
+                << " of input obj file '" 
+                << filename 
+                << "', 3 or 6 values expected but "
+                << tokens.size()-1 // -1 for the front token (v) 
+                << " read instead, line skipped" 
+                << std::endl;
+        }
+    }
+    else if(tokens.front() == "vn")
+    {
+        // line = "vn nx ny nz"
+        if(tokens.size() == 4)
+        {
+            chunk.normals.push_back(Eigen::Vector3f{
+                std::stof(tokens[1]),
+                std::stof(tokens[2]),
+                std::stof(tokens[3])
+            });
+        }
+        else
+        {
+            chunk.warnings << "Warning: "
+                << "failed to read line " 
+                << idx_line 
+                << " of input obj file '" 
+                << filename 
+                << "', 3 values expected but "
+                << tokens.size()-1 // -1 for the front token (vn) 
+                << " read instead, line skipped" 
+                << std::endl;
+        }
+    }
+    else
+    {
+        chunk.warnings << "Warning: " 
+            << "failed to read line " 
+            << idx_line 
+            << " of input obj file '" 
+            << filename 
+            << "', 'v' or 'vn' expected but '" 
+            << tokens.front()
+            << "' read instead, line skipped"
+            << std::endl;
+    }
+}
+
 bool load_obj(
     const std::string& filename, 
     std::vector<Eigen::Vector3f>& points,
@@ -50,8 +168,8 @@ bool load_obj(
     normals.clear();
     colors.clear();
 
-    std::ifstream fs(filename);
-    if(not fs.is_open())
+    MappedFile file;
+    if(not file.open(filename))
     {
         std::cout << "Error: "
             << "failed to open input obj file '" 
@@ -61,95 +179,70 @@ bool load_obj(
         return false;
     }
 
-    std::string line;
-    for(auto idx_line = 0; std::getline(fs, line); ++idx_line)
+    // the file is cut in chunks of whole lines read in parallel
+    ThreadPool& pool = default_thread_pool();
+    const char* data = file.data();
+    const char* data_end = data + file.size();
+    const auto number_of_chunks = file.size() < parallel_obj_min_size ? 1 : 4 * pool.size();
+
+    std::vector<ObjChunk> chunks(number_of_chunks);
+    for(auto c = 0u; c < number_of_chunks; ++c)
     {
-        const auto tokens = split(line);
-        if(line.empty()) 
-        {
-            // empty line
-            // nothing to do
-        }
-        else if(line.front() == '#')
+        const char* begin = data + file.size() * c / number_of_chunks;
+        if(c > 0)
         {
-            // comment = "# ..."
-            // nothing to do
-        }
-        if(not tokens.empty() and tokens.front() == "v")
-        {
-            // line = "v x y z"
-            // or line = "v x y z r g b"
-            if(tokens.size() == 4)
-            {
-                points.push_back(Eigen::Vector3f{
-                    std::stof(tokens[1]),
-                    std::stof(tokens[2]),
-                    std::stof(tokens[3])
-                });
-            }
-            else if(tokens.size() == 7)
-            {
-                points.push_back(Eigen::Vector3f{
-                    std::stof(tokens[1]),
-                    std::stof(tokens[2]),
-                    std::stof(tokens[3])
-                });
-                colors.push_back(Eigen::Vector3f{
-                    std::stof(tokens[4]),
-                    std::stof(tokens[5]),
-                    std::stof(tokens[6])
-                });
-            }
-            else
-            {
-                std::cout << "Warning: "
-                    << "failed to read line " 
-                    << idx_line 
-                    << " of input obj file '" 
-                    << filename 
-                    << "', 3 or 6 values expected but "
-                    << tokens.size()-1 // -1 for the front token (v) 
-                    << " read instead, line skipped" 
-                    << std::endl;
-            }
+            begin = std::max(begin, chunks[c-1].begin);
+            begin = std::find(begin, data_end, '\n');
+            if(begin != data_end)
+                ++begin;
+            chunks[c-1].end = begin;
         }
-        else if(not tokens.empty() and tokens.front() == "vn")
+        chunks[c].begin = begin;
+    }
+    chunks.back().end = data_end;
+
+    // index of the first line of each chunk
+    pool.parallel_chunks(number_of_chunks, number_of_chunks, [&](uint c, uint, uint)
+    {
+        chunks[c].first_line = std::count(chunks[c].begin, chunks[c].end, '\n');
+    });
+    for(auto c = 0u, first_line = 0u; c < number_of_chunks; ++c)
+        first_line += std::exchange(chunks[c].first_line, first_line);
+
+    pool.parallel_chunks(number_of_chunks, number_of_chunks, [&](uint c, uint, uint)
+    {
+        ObjChunk& chunk = chunks[c];
+        std::string line;
+        auto idx_line = chunk.first_line;
+        for(const char* it = chunk.begin; it < chunk.end; ++idx_line)
         {
-            // line = "vn nx ny nz"
-            if(tokens.size() == 4)
+            const char* line_end = std::find(it, chunk.end, '\n');
+            line.assign(it, line_end);
+            try
             {
-                normals.push_back(Eigen::Vector3f{
-                    std::stof(tokens[1]),
-                    std::stof(tokens[2]),
-                    std::stof(tokens[3])
-                });
+                parse_obj_line(filename, line, idx_line, chunk);
             }
-            else
+            catch(const std::exception&)
             {
-                std::cout << "Warning: "
-                    << "failed to read line " 
-                    << idx_line 
-                    << " of input obj file '" 
-                    << filename 
-                    << "', 3 values expected but "
-                    << tokens.size()-1 // -1 for the front token (vn) 
-                    << " read instead, line skipped" 
+                chunk.warnings << "Warning: "
+                    << "failed to read line "
+                    << idx_line
+                    << " of input obj file '"
+                    << filename
+                    << "', invalid or out of range value, line skipped"
                     << std::endl;
             }
+            it = line_end + 1;
         }
-        else
-        {
-            std::cout << "Warning: " 
-                << "failed to read line " 
-                << idx_line 
-                << " of input obj file '" 
-                << filename 
-                << "', 'v' or 'vn' expected but '" 
-                << tokens.front()
-                << "' read instead, line skipped"
-                << std::endl;
-        }
-    } // end of loop
+    });
+
+    for(ObjChunk& chunk : chunks)
+    {
+        std::cout << chunk.warnings.str();
+        points.insert(points.end(), chunk.points.begin(), chunk.points.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        colors.insert(colors.end(), chunk.colors.begin(), chunk.colors.end());
+    }
 
     if(points.size() == 0) 
     {
@@ -392,7 +485,8 @@ bool save_obj(
     const std::vector<Eigen::Vector3f>& points,
     const std::vector<Eigen::Vector3f>& normals,
     const std::vector<Eigen::Vector3f>& colors,
-    const std::vector<Eigen::Vector3i>& faces)
+    const std::vector<Eigen::Vector3i>& faces,
+    const Eigen::Vector3d& origin)
 {
     std::ofstream fs(filename);
     if(not fs.is_open())
@@ -443,12 +537,19 @@ bool save_obj(
             << std::endl;
     }
 
+    // georeferenced coordinates need more digits
+    const auto precision = fs.precision();
+    const auto point_precision = origin.isZero() ? precision : 12;
+
     for(auto i = 0u; i < points.size(); ++i)
     {
+        const Eigen::Vector3d p = points[i].cast<double>() + origin;
         fs << "v " 
-            << points[i].x() << ' '
-            << points[i].y() << ' '
-            << points[i].z();
+            << std::setprecision(point_precision)
+            << p.x() << ' '
+            << p.y() << ' '
+            << p.z()
+            << std::setprecision(precision);
         if(save_colors)
         {
             fs << ' '
@@ -39,12 +39,14 @@ bool save_obj(
     const std::vector<Eigen::Vector3f>& normals,
     const std::vector<Eigen::Vector3i>& faces);
     
+// origin is added to the points (in double precision)
 bool save_obj(
     const std::string& filename, 
     const std::vector<Eigen::Vector3f>& points,
     const std::vector<Eigen::Vector3f>& normals,
     const std::vector<Eigen::Vector3f>& colors,
-    const std::vector<Eigen::Vector3i>& faces);
+    const std::vector<Eigen::Vector3i>& faces,
+    const Eigen::Vector3d& origin = Eigen::Vector3d::Zero());
 
 
 } // namespace tnp
\ No newline at end of file
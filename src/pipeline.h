@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace tnp {
+
+//
+// First in first out queue holding at most capacity values shared by
+// threads: push waits while the queue is full (back-pressure on the
+// producer) and pop waits while it is empty. Closing the queue wakes every
+// waiting thread, push fails from then on and pop once the queue is empty.
+//
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(uint capacity) : m_capacity(std::max(1u, capacity)) {}
+
+  // Wait for room and add the value, false if the queue is closed
+  bool push(T value) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_full.wait(lock,
+                    [&] { return m_closed || m_values.size() < m_capacity; });
+    if (m_closed) return false;
+    m_values.push_back(std::move(value));
+    m_not_empty.notify_one();
+    return true;
+  }
+
+  // Wait for a value and remove it, false once the queue is closed and empty
+  bool pop(T& value) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_not_empty.wait(lock, [&] { return m_closed || !m_values.empty(); });
+    if (m_values.empty()) return false;
+    value = std::move(m_values.front());
+    m_values.pop_front();
+    m_not_full.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closed = true;
+    m_not_full.notify_all();
+    m_not_empty.notify_all();
+  }
+
+ private:
+  const uint m_capacity;
+  std::mutex m_mutex;
+  std::condition_variable m_not_full;
+  std::condition_variable m_not_empty;
+  std::deque<T> m_values;
+  bool m_closed = false;
+};
+
+//
+// Run the items 0 to count - 1 through 3 stages: load(i, item) on a loader
+// thread, process(item) on the calling thread and save(item) on a saver
+// thread, so that loading item i + 1 and saving item i - 1 overlap with
+// processing item i. Stages see the items in order and hold at most one at a
+// time; at most capacity items wait between two stages, which bounds the
+// memory to 2 * capacity + 3 items.
+//
+// A stage returns false on error and run_pipeline then returns false. With
+// stop_on_error, the pipeline stops and the items already processed are
+// still saved. Otherwise the failed item is dropped and the next ones go on
+// (e.g. independent files, one of which cannot be read).
+//
+// Example:
+//     run_pipeline<Frame>(files.size(), 2,
+//         [&](uint i, Frame& frame) { return load(files[i], frame); },
+//         [&](Frame& frame) { return detect(frame); },
+//         [&](Frame& frame) { return save(frame); });
+//
+template <typename Item, typename Load, typename Process, typename Save>
+bool run_pipeline(const uint count, const uint capacity, Load load,
+                  Process process, Save save, const bool stop_on_error = true) {
+  BoundedQueue<std::unique_ptr<Item>> loaded(capacity);
+  BoundedQueue<std::unique_ptr<Item>> processed(capacity);
+  std::atomic<bool> failed = false;
+
+  std::thread loader([&] {
+    for (uint i = 0; i < count; i++) {
+      auto item = std::make_unique<Item>();
+      if (!load(i, *item)) {
+        failed = true;
+        if (stop_on_error) break;
+        continue;
+      }
+      if (!loaded.push(std::move(item))) break;
+    }
+    loaded.close();
+  });
+
+  std::thread saver([&] {
+    std::unique_ptr<Item> item;
+    while (processed.pop(item)) {
+      if (!save(*item)) {
+        failed = true;
+        if (!stop_on_error) continue;
+        processed.close();
+        break;
+      }
+    }
+  });
+
+  std::unique_ptr<Item> item;
+  while (loaded.pop(item)) {
+    if (!process(*item)) {
+      failed = true;
+      if (stop_on_error) break;
+      continue;
+    }
+    if (!processed.push(std::move(item))) break;
+  }
+
+  // Stop the loader if a stage failed, let the saver finish its queue
+  loaded.close();
+  processed.close();
+  loader.join();
+  saver.join();
+  return !failed;
+}
+
+}  // namespace tnp
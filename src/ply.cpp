@@ -0,0 +1,453 @@
+#include <ply.h>
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace tnp {
+
+enum class PlyType { int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+struct PlyProperty
+{
+    std::string name;
+    PlyType type;
+    std::size_t offset; // offset in bytes from the beginning of the element
+    bool is_list;
+};
+
+struct PlyElement
+{
+    std::string name;
+    std::size_t count;
+    std::vector<PlyProperty> properties;
+    std::size_t stride; // size in bytes of one element (without list properties)
+};
+
+bool parse_ply_type(const std::string& name, PlyType& type)
+{
+    if(name == "char" or name == "int8")
+        type = PlyType::int8;
+    else if(name == "uchar" or name == "uint8")
+        type = PlyType::uint8;
+    else if(name == "short" or name == "int16")
+        type = PlyType::int16;
+    else if(name == "ushort" or name == "uint16")
+        type = PlyType::uint16;
+    else if(name == "int" or name == "int32")
+        type = PlyType::int32;
+    else if(name == "uint" or name == "uint32")
+        type = PlyType::uint32;
+    else if(name == "float" or name == "float32")
+        type = PlyType::float32;
+    else if(name == "double" or name == "float64")
+        type = PlyType::float64;
+    else
+        return false;
+    return true;
+}
+
+std::size_t ply_type_size(PlyType type)
+{
+    switch(type)
+    {
+    case PlyType::int8:
+    case PlyType::uint8:   return 1;
+    case PlyType::int16:
+    case PlyType::uint16:  return 2;
+    case PlyType::int32:
+    case PlyType::uint32:
+    case PlyType::float32: return 4;
+    default:               return 8;
+    }
+}
+
+bool is_little_endian()
+{
+    const uint16_t one = 1;
+    return *reinterpret_cast<const uint8_t*>(&one) == 1;
+}
+
+template<typename T>
+T read_raw(const char* data, bool swap)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, data, sizeof(T));
+    if(swap)
+        std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+// read a property as a float, integer colors are normalized by their maximum
+float read_ply_value(const char* data, PlyType type, bool swap, bool normalize)
+{
+    switch(type)
+    {
+    case PlyType::int8:    return read_raw<int8_t>(data, swap)   / (normalize ? 127.f : 1.f);
+    case PlyType::uint8:   return read_raw<uint8_t>(data, swap)  / (normalize ? 255.f : 1.f);
+    case PlyType::int16:   return read_raw<int16_t>(data, swap)  / (normalize ? 32767.f : 1.f);
+    case PlyType::uint16:  return read_raw<uint16_t>(data, swap) / (normalize ? 65535.f : 1.f);
+    case PlyType::int32:   return read_raw<int32_t>(data, swap);
+    case PlyType::uint32:  return read_raw<uint32_t>(data, swap);
+    case PlyType::float32: return read_raw<float>(data, swap);
+    default:               return read_raw<double>(data, swap);
+    }
+}
+
+// find the offsets of the properties named by names, false if one is missing
+bool find_ply_properties(
+    const PlyElement& element,
+    const char* const names[3],
+    const PlyProperty* properties[3])
+{
+    for(auto d = 0; d < 3; ++d)
+    {
+        const auto it = std::find_if(element.properties.begin(), element.properties.end(),
+            [&](const PlyProperty& p){ return p.name == names[d] and not p.is_list; });
+        if(it == element.properties.end())
+            return false;
+        properties[d] = &*it;
+    }
+    return true;
+}
+
+bool load_ply(
+    const std::string& filename,
+    std::vector<Eigen::Vector3f>& points,
+    std::vector<Eigen::Vector3f>& normals,
+    std::vector<Eigen::Vector3f>& colors)
+{
+    points.clear();
+    normals.clear();
+    colors.clear();
+
+    MappedFile file;
+    if(not file.open(filename))
+    {
+        std::cout << "Error: "
+            << "failed to open input ply file '"
+            << filename
+            << "', file not found, nothing loaded"
+            << std::endl;
+        return false;
+    }
+
+    // header ------------------------------------------------------------------
+    const char* const end_header = "end_header";
+    const char* header_end = std::search(file.data(), file.data() + file.size(),
+        end_header, end_header + std::strlen(end_header));
+    const char* body = std::find(header_end, file.data() + file.size(), '\n');
+    if(body == file.data() + file.size())
+    {
+        std::cout << "Error: "
+            << "failed to read the header of input ply file '"
+            << filename
+            << "', nothing loaded"
+            << std::endl;
+        return false;
+    }
+    ++body;
+
+    std::istringstream header(std::string(file.data(), header_end));
+    std::string line;
+    std::string format;
+    std::vector<PlyElement> elements;
+    while(std::getline(header, line))
+    {
+        std::istringstream ss(line);
+        std::string keyword;
+        ss >> keyword;
+        if(keyword == "format")
+        {
+            ss >> format;
+        }
+        else if(keyword == "element")
+        {
+            PlyElement element;
+            ss >> element.name >> element.count;
+            element.stride = 0;
+            elements.push_back(element);
+        }
+        else if(keyword == "property" and not elements.empty())
+        {
+            PlyProperty property;
+            std::string type;
+            ss >> type;
+            property.is_list = type == "list";
+            if(property.is_list)
+            {
+                std::string count_type;
+                ss >> count_type >> type;
+            }
+            ss >> property.name;
+            if(not parse_ply_type(type, property.type))
+            {
+                std::cout << "Error: "
+                    << "unknown property type '"
+                    << type
+                    << "' in input ply file '"
+                    << filename
+                    << "', nothing loaded"
+                    << std::endl;
+                return false;
+            }
+            property.offset = elements.back().stride;
+            elements.back().stride += ply_type_size(property.type);
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    if(format != "binary_little_endian" and format != "binary_big_endian")
+    {
+        std::cout << "Error: "
+            << "unsupported format '"
+            << format
+            << "' of input ply file '"
+            << filename
+            << "', binary_little_endian or binary_big_endian expected, nothing loaded"
+            << std::endl;
+        return false;
+    }
+    const auto swap = (format == "binary_little_endian") != is_little_endian();
+
+    // skip the elements stored before the vertices (they must have a fixed size)
+    const PlyElement* vertex = nullptr;
+    for(const auto& element : elements)
+    {
+        if(element.name == "vertex")
+        {
+            vertex = &element;
+            break;
+        }
+        const auto has_list = std::any_of(element.properties.begin(), element.properties.end(),
+            [](const PlyProperty& p){ return p.is_list; });
+        if(has_list)
+        {
+            std::cout << "Error: "
+                << "element '"
+                << element.name
+                << "' with list properties stored before the vertices in input ply file '"
+                << filename
+                << "', nothing loaded"
+                << std::endl;
+            return false;
+        }
+        body += element.count * element.stride;
+    }
+
+    const char* const xyz_names[3] = {"x", "y", "z"};
+    const char* const normal_names[3] = {"nx", "ny", "nz"};
+    const char* const color_names[3] = {"red", "green", "blue"};
+    const PlyProperty* xyz[3];
+    const PlyProperty* normal[3];
+    const PlyProperty* color[3];
+
+    if(vertex == nullptr or vertex->count == 0
+        or not find_ply_properties(*vertex, xyz_names, xyz))
+    {
+        std::cout << "Error: "
+            << "no points read from input ply file '"
+            << filename
+            << "'"
+            << std::endl;
+        return false;
+    }
+    const auto has_list = std::any_of(vertex->properties.begin(), vertex->properties.end(),
+        [](const PlyProperty& p){ return p.is_list; });
+    if(has_list or body + vertex->count * vertex->stride > file.data() + file.size())
+    {
+        std::cout << "Error: "
+            << "failed to read the vertices of input ply file '"
+            << filename
+            << "', nothing loaded"
+            << std::endl;
+        return false;
+    }
+    const auto has_normals = find_ply_properties(*vertex, normal_names, normal);
+    const auto has_colors = find_ply_properties(*vertex, color_names, color);
+
+    // body --------------------------------------------------------------------
+    points.resize(vertex->count);
+    if(has_normals)
+        normals.resize(vertex->count);
+    if(has_colors)
+        colors.resize(vertex->count);
+
+    // float x y z stored contiguously in the host byte order: direct copy
+    const auto raw_xyz = not swap
+        and xyz[0]->type == PlyType::float32
+        and xyz[1]->type == PlyType::float32
+        and xyz[2]->type == PlyType::float32
+        and xyz[1]->offset == xyz[0]->offset + 4
+        and xyz[2]->offset == xyz[0]->offset + 8;
+
+    if(raw_xyz and vertex->stride == sizeof(Eigen::Vector3f))
+    {
+        std::memcpy(static_cast<void*>(points.data()), body, vertex->count * vertex->stride);
+    }
+    else
+    {
+        for(auto i = 0u; i < vertex->count; ++i)
+        {
+            const char* v = body + i * vertex->stride;
+            if(raw_xyz)
+                std::memcpy(points[i].data(), v + xyz[0]->offset, sizeof(Eigen::Vector3f));
+            else
+                for(auto d = 0; d < 3; ++d)
+                    points[i][d] = read_ply_value(v + xyz[d]->offset, xyz[d]->type, swap, false);
+        }
+    }
+
+    for(auto i = 0u; i < vertex->count and (has_normals or has_colors); ++i)
+    {
+        const char* v = body + i * vertex->stride;
+        for(auto d = 0; d < 3; ++d)
+        {
+            if(has_normals)
+                normals[i][d] = read_ply_value(v + normal[d]->offset, normal[d]->type, swap, false);
+            if(has_colors)
+                colors[i][d] = read_ply_value(v + color[d]->offset, color[d]->type, swap, true);
+        }
+    }
+
+    std::cout << "Loaded "
+        << points.size()
+        << " points from ply file '" << filename << "'";
+    if(not normals.empty() and not colors.empty())
+        std::cout << " (with normals and colors)";
+    else if(not normals.empty())
+        std::cout << " (with normals)";
+    else if(not colors.empty())
+        std::cout << " (with colors)";
+    std::cout << std::endl;
+    return true;
+}
+
+bool save_ply(
+    const std::string& filename,
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>& normals,
+    const std::vector<Eigen::Vector3f>& colors,
+    const Eigen::Vector3d& origin)
+{
+    std::ofstream fs(filename, std::ios::binary);
+    if(not fs.is_open())
+    {
+        std::cout << "Error: "
+            << "failed to open output ply file '"
+            << filename
+            << "', file not found, nothing saved"
+            << std::endl;
+        return false;
+    }
+
+    const auto save_normals = (not normals.empty()) and normals.size() == points.size();
+    const auto save_colors  = (not colors.empty())  and colors.size()  == points.size();
+
+    if((not normals.empty()) and normals.size() != points.size())
+    {
+        std::cout << "Warning: "
+            << "normals size ("
+            << normals.size()
+            << ") is different from points size ("
+            << points.size()
+            << "), normals not saved to output ply file '"
+            << filename
+            << "'"
+            << std::endl;
+    }
+    if((not colors.empty()) and colors.size() != points.size())
+    {
+        std::cout << "Warning: "
+            << "colors size ("
+            << colors.size()
+            << ") is different from points size ("
+            << points.size()
+            << "), colors not saved to output ply file '"
+            << filename
+            << "'"
+            << std::endl;
+    }
+
+    // georeferenced coordinates do not fit in a float
+    const auto translated = not origin.isZero();
+    const auto coordinate_type = translated ? "double" : "float";
+
+    fs << "ply\n"
+        << "format binary_little_endian 1.0\n"
+        << "element vertex " << points.size() << '\n'
+        << "property " << coordinate_type << " x\n"
+        << "property " << coordinate_type << " y\n"
+        << "property " << coordinate_type << " z\n";
+    if(save_normals)
+    {
+        fs << "property float nx\n"
+            << "property float ny\n"
+            << "property float nz\n";
+    }
+    if(save_colors)
+    {
+        fs << "property uchar red\n"
+            << "property uchar green\n"
+            << "property uchar blue\n";
+    }
+    fs << "end_header\n";
+
+    // vertices are written by blocks to avoid one stream call per value
+    const auto stride = (translated ? 24 : 12) + (save_normals ? 12 : 0) + (save_colors ? 3 : 0);
+    const auto block_size = 1u << 16;
+    const auto swap = not is_little_endian();
+    std::vector<char> block;
+    block.reserve(std::size_t(block_size) * stride);
+
+    auto write = [&](auto value)
+    {
+        char bytes[sizeof(value)];
+        std::memcpy(bytes, &value, sizeof(value));
+        if(swap)
+            std::reverse(bytes, bytes + sizeof(value));
+        block.insert(block.end(), bytes, bytes + sizeof(value));
+    };
+    auto write_float = [&](float value) { write(value); };
+
+    for(auto i = 0u; i < points.size(); ++i)
+    {
+        for(auto d = 0; d < 3; ++d)
+            if(translated)
+                write(points[i][d] + origin[d]);
+            else
+                write_float(points[i][d]);
+        if(save_normals)
+            for(auto d = 0; d < 3; ++d)
+                write_float(normals[i][d]);
+        if(save_colors)
+            for(auto d = 0; d < 3; ++d)
+                block.push_back(char(std::clamp(std::lround(colors[i][d] * 255), 0l, 255l)));
+
+        if(block.size() >= std::size_t(block_size) * stride or i + 1 == points.size())
+        {
+            fs.write(block.data(), block.size());
+            block.clear();
+        }
+    }
+
+    std::cout << "Saved "
+        << points.size()
+        << " points to ply file '" << filename << "'";
+    if(save_normals and save_colors)
+        std::cout << " (with normals and colors)";
+    else if(save_normals)
+        std::cout << " (with normals)";
+    else if(save_colors)
+        std::cout << " (with colors)";
+    std::cout << std::endl;
+    return true;
+}
+
+} // namespace tnp
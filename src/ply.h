@@ -0,0 +1,33 @@
+#pragma once
+
+#include <Eigen/Core>
+
+#include <string>
+#include <vector>
+
+namespace tnp {
+
+//
+// Binary (little or big endian) PLY files
+// only the vertex element is read: x y z, nx ny nz and red green blue
+// (integer colors are divided by their maximum value)
+//
+bool load_ply(
+    const std::string& filename,
+    std::vector<Eigen::Vector3f>& points,
+    std::vector<Eigen::Vector3f>& normals,
+    std::vector<Eigen::Vector3f>& colors);
+
+//
+// Binary little endian PLY file with float x y z, float nx ny nz (if normals
+// are given) and uchar red green blue (if colors are given)
+// a non zero origin is added to the points, which are then saved as double
+//
+bool save_ply(
+    const std::string& filename,
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>& normals,
+    const std::vector<Eigen::Vector3f>& colors,
+    const Eigen::Vector3d& origin = Eigen::Vector3d::Zero());
+
+} // namespace tnp
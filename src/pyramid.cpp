@@ -0,0 +1,23 @@
+#include "pyramid.h"
+
+namespace tnp {
+
+void Pyramid::build(const KdTree& kdtree, const uint number_of_levels,
+                    const uint factor, const uint min_level_size) {
+  levels.clear();
+  levels.emplace_back(kdtree.m_indices.begin(), kdtree.m_indices.end());
+  if (factor < 2) return;
+
+  uint stride = factor;
+  while (levels.size() < number_of_levels &&
+         levels.front().size() / stride >= min_level_size) {
+    std::vector<uint> level;
+    level.reserve(levels.front().size() / stride + 1);
+    for (uint k = 0; k < levels.front().size(); k += stride)
+      level.push_back(levels.front()[k]);
+    levels.push_back(std::move(level));
+    stride *= factor;
+  }
+}
+
+}  // namespace tnp
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "kdtree.h"
+
+namespace tnp {
+
+//
+// Multi-level point pyramid: levels[0] holds the indices of every point in
+// KdTree leaf order and each next level keeps one point out of factor of the
+// previous one. Since consecutive points in leaf order are spatial neighbors,
+// every level covers the whole cloud with a uniform density.
+//
+// The levels only store indices: removed points are masked by the caller, so
+// the pyramid is built once and reused across the rounds of ransac_multi.
+//
+struct Pyramid {
+  std::vector<std::vector<uint>> levels;
+
+  // Build at most number_of_levels levels, a level is only added if it keeps
+  // at least min_level_size points. A factor below 2 only builds levels[0]
+  void build(const KdTree& kdtree, const uint number_of_levels,
+             const uint factor, const uint min_level_size = 64);
+};
+
+}  // namespace tnp
@@ -0,0 +1,54 @@
+#include "quantized.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "normal_index.h"
+
+namespace tnp {
+
+void QuantizedCloud::build(const std::vector<Eigen::Vector3f>& points,
+                           const std::vector<Eigen::Vector3f>* normals) {
+  const uint size = points.size();
+  tiles.resize((size + tile_size - 1) / tile_size);
+  for (auto& c : coordinates) c.resize(size);
+  this->normals.clear();
+
+  for (uint t = 0; t < tiles.size(); t++) {
+    const uint begin = t * tile_size;
+    const uint end = std::min(size, begin + tile_size);
+
+    Eigen::AlignedBox<float, 3> box;
+    for (uint i = begin; i < end; i++) box.extend(points[i]);
+
+    // Steps are never null so that flat tiles can be decoded
+    Tile& tile = tiles[t];
+    tile.origin = box.center();
+    tile.scale = (box.diagonal() / (2 * 32767.f))
+                     .cwiseMax(std::numeric_limits<float>::min());
+
+    for (uint i = begin; i < end; i++) {
+      const Eigen::Vector3f q =
+          (points[i] - tile.origin).cwiseQuotient(tile.scale);
+      for (uint d = 0; d < 3; d++)
+        coordinates[d][i] =
+            int16_t(std::clamp(std::lround(q[d]), -32767l, 32767l));
+    }
+  }
+
+  if (normals != nullptr) {
+    auto byte = [](float x) {
+      return uint16_t(uint8_t(int8_t(
+          std::clamp(std::lround(x * normal_scale), -127l, 127l))));
+    };
+    this->normals.resize(size);
+    for (uint i = 0; i < size; i++) {
+      const Eigen::Vector2f v = octahedral_coordinates((*normals)[i]);
+      this->normals[i] = uint16_t(byte(v.x()) | byte(v.y()) << 8);
+    }
+  }
+}
+
+}  // namespace tnp
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace tnp {
+
+//
+// Point cloud stored with 16-bit fixed point coordinates: points are grouped
+// in tiles of tile_size consecutive points, each tile having its own origin
+// and scale, and unit normals are stored as 16-bit codes of their octahedral
+// coordinates (8 bits each). Each coordinate has its own array so that
+// scoring loops are vectorized. A point takes 8 bytes with its normal
+// instead of 24.
+//
+// Tiles are only tight (and the precision high) if consecutive points are
+// spatially close, e.g. after sorting the points along a space-filling curve.
+//
+struct QuantizedCloud {
+  static constexpr uint tile_size = 4096;
+  static constexpr float normal_scale = 127;  // of the octahedral codes
+
+  struct Tile {
+    Eigen::Vector3f origin;  // center of the bounding box of the tile
+    Eigen::Vector3f scale;   // size of a quantization step on each axis
+  };
+
+  std::vector<Tile> tiles;
+  std::array<std::vector<int16_t>, 3> coordinates;  // x, y and z
+  std::vector<uint16_t> normals;  // empty if the cloud has none
+
+  // Quantize the points (and the normals if not nullptr), the buffers are
+  // reused
+  void build(const std::vector<Eigen::Vector3f>& points,
+             const std::vector<Eigen::Vector3f>* normals = nullptr);
+
+  uint size() const { return coordinates[0].size(); }
+  bool has_normals() const { return !normals.empty(); }
+
+  // Decoded point i
+  Eigen::Vector3f operator[](const uint i) const {
+    const Tile& tile = tiles[i / tile_size];
+    return tile.origin + tile.scale.cwiseProduct(Eigen::Vector3f(
+                             coordinates[0][i], coordinates[1][i],
+                             coordinates[2][i]));
+  }
+
+  // Decoded normal i
+  Eigen::Vector3f normal(const uint i) const {
+    return decode_normal(normals[i]);
+  }
+
+  // Unit normal of an octahedral code, whose low and high bytes are the
+  // signed octahedral coordinates times normal_scale
+  static Eigen::Vector3f decode_normal(const uint16_t code) {
+    return scaled_normal(code).normalized();
+  }
+
+  // Normal of an octahedral code times its L1 norm times normal_scale (no
+  // division nor square root, for the scoring loops)
+  static Eigen::Vector3f scaled_normal(const uint16_t code) {
+    const float u = int8_t(code & 0xff);
+    const float v = int8_t(code >> 8);
+    const float z = normal_scale - std::abs(u) - std::abs(v);
+    const float fold = std::max(-z, 0.f);  // unfold the lower hemisphere
+    return {u - std::copysign(fold, u), v - std::copysign(fold, v), z};
+  }
+};
+
+}  // namespace tnp
@@ -1,25 +1,24 @@
 #include "ransac.h"
 
+#include "connectivity.h"
+#include "pyramid.h"
+#include "quantized.h"
+#include "thread_pool.h"
+#include "voxel_grid.h"
+
 #include <math.h> /* sqrt & pow*/
 
 #include <Eigen/Geometry>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <iterator>
 #include <numeric>
+#include <tuple>
+#include <type_traits>
 
 namespace tnp {
 
-#define NORMAL_ALIGNMENT_THRESHOLD 0.75
-
-// Merge two vectors
-std::vector<uint> merge(const std::vector<uint>& a,
-                        const std::vector<uint>& b) {
-  std::vector<uint> ab;
-  ab.reserve(a.size() + b.size());
-  ab.insert(ab.end(), a.begin(), a.end());
-  ab.insert(ab.end(), b.begin(), b.end());
-  return ab;
-}
-
 std::vector<float> insert_sorted(std::vector<float> vector, float value) {
   if (vector.size() == 0) return {value};
 
@@ -32,9 +31,9 @@ std::vector<float> insert_sorted(std::vector<float> vector, float value) {
   return vector;
 }
 
-float dist_mean_closest_neighbors(std::vector<Eigen::Vector3f> cloud,
-                                  std::vector<uint> points, uint base_point,
-                                  uint k) {
+float dist_mean_closest_neighbors(const std::vector<Eigen::Vector3f>& cloud,
+                                  const std::vector<uint>& points,
+                                  uint base_point, uint k) {
   uint points_size = points.size();
 
   std::vector<float> closest_neighbors;
@@ -62,22 +61,27 @@ float dist_mean_closest_neighbors(std::vector<Eigen::Vector3f> cloud,
 }
 
 std::pair<std::vector<uint>, std::vector<uint>> outliers_removal(
-    std::vector<Eigen::Vector3f> cloud, std::vector<uint> inliers,
+    const std::vector<Eigen::Vector3f>& cloud,
+    const std::vector<uint>& inliers,
     std::vector<uint> remaining_point_cloud) {
-  std::vector<std::pair<uint, float>> points_d_mean;
-
   uint inliers_size = inliers.size();
+  std::vector<std::pair<uint, float>> points_d_mean(inliers_size);
 
-  float mean = 0;
-  for (uint i = 0; i < inliers_size; i++) {
-    float dist_mean =
-        dist_mean_closest_neighbors(cloud, inliers, inliers[i], 200);
+  // Each inlier searches its neighbors among all the inliers, in parallel
+  default_thread_pool().parallel_for(
+      inliers_size, 16, [&](uint begin, uint end) {
+        for (uint i = begin; i < end; i++) {
+          float dist_mean =
+              dist_mean_closest_neighbors(cloud, inliers, inliers[i], 200);
+
+          // Saves the point and its d_mean distance
+          points_d_mean[i] = {inliers[i], dist_mean};
+        }
+      });
 
-    // Saves the point and its d_mean distance
-    std::pair<uint, float> point_d_mean(inliers[i], dist_mean);
-    points_d_mean.push_back(point_d_mean);
+  float mean = 0;
+  for (std::pair<uint, float> point_d_mean : points_d_mean)
     mean += point_d_mean.second;
-  }
   mean /= (float)points_d_mean.size();
 
   float standard_deviation = 0;
@@ -96,115 +100,1245 @@ std::pair<std::vector<uint>, std::vector<uint>> outliers_removal(
   }
   return {new_inliers, remaining_point_cloud};
 }
+// Labels of the points with respect to a hypothesis
+enum Label : uint8_t { OUTLIER = 0, INLIER = 1, INLIER_BACKFACE = 2 };
+
+// How the normals take part in the classification: ignored (no normals),
+// unoriented (the inliers are the points on the side of the shape with most
+// of them) or oriented (only the points whose normal faces the same way as
+// the shape are inliers). The mode is chosen once per call and the loops over
+// the points are compiled for each one.
+enum NormalMode : uint8_t { NO_NORMALS, UNORIENTED_NORMALS, ORIENTED_NORMALS };
+
+NormalMode normal_mode(const std::vector<Eigen::Vector3f>* normals,
+                       const bool oriented) {
+  if (normals == nullptr) return NO_NORMALS;
+  return oriented ? ORIENTED_NORMALS : UNORIENTED_NORMALS;
+}
+
+// Call f with the mode as an std::integral_constant
+template <typename Func>
+decltype(auto) with_normal_mode(const NormalMode mode, Func f) {
+  switch (mode) {
+    case UNORIENTED_NORMALS:
+      return f(std::integral_constant<NormalMode, UNORIENTED_NORMALS>());
+    case ORIENTED_NORMALS:
+      return f(std::integral_constant<NormalMode, ORIENTED_NORMALS>());
+    default:
+      return f(std::integral_constant<NormalMode, NO_NORMALS>());
+  }
+}
 
-// Ransac for plane detection in 3D
-// Normlas should be normalized, otherwise the normal error will be wrong
+// Side of the point i with respect to the shape: INLIER if its normal faces
+// the same way as the shape (front), INLIER_BACKFACE if it faces the opposite
+// way (back, only with unoriented normals), OUTLIER if it is not aligned,
+// always INLIER without normals
+// Normals should be normalized, otherwise the normal error will be wrong
 // because it would not be a cosine distance anymore
-std::pair<std::vector<uint>, std::vector<uint>> ransac(
+template <NormalMode mode, typename Shape>
+inline uint8_t side_of(const Shape& shape,
+                       const std::vector<Eigen::Vector3f>& points,
+                       const std::vector<Eigen::Vector3f>* normals,
+                       const uint i) {
+  if constexpr (mode == NO_NORMALS) {
+    return INLIER;
+  } else {
+    const float alignment = shape.normal_at(points[i]).dot((*normals)[i]);
+    if constexpr (mode == ORIENTED_NORMALS)
+      return alignment > NORMAL_ALIGNMENT_THRESHOLD;
+    else
+      return (alignment > NORMAL_ALIGNMENT_THRESHOLD) |
+             ((alignment < -NORMAL_ALIGNMENT_THRESHOLD) << 1);
+  }
+}
+
+// Label of the point i with respect to the shape: its side if it is closer
+// than threshold, OUTLIER otherwise
+template <NormalMode mode, typename Shape>
+inline uint8_t label_of(const Shape& shape,
+                        const std::vector<Eigen::Vector3f>& points,
+                        const std::vector<Eigen::Vector3f>* normals,
+                        const float threshold, const uint i) {
+  const uint8_t close = shape.distance(points[i]) <= threshold;
+  return close * side_of<mode>(shape, points, normals, i);
+}
+
+// Type of the score of a point: inliers are counted exactly
+template <Scoring scoring>
+using PointScore = std::conditional_t<scoring == INLIER_COUNT, uint, float>;
+
+// Type of the sum of the scores of the points: float sums drift by percents
+// over tens of millions of points, more than the gaps between close
+// hypotheses
+template <Scoring scoring>
+using ScoreSum = std::conditional_t<scoring == INLIER_COUNT, uint, double>;
+
+// Score of a point at the given distance of a hypothesis (see Scoring),
+// branchless so that the loops over the points vectorize
+template <Scoring scoring>
+inline PointScore<scoring> point_score(const float distance,
+                                       const float threshold) {
+  if constexpr (scoring == INLIER_COUNT) {
+    return distance <= threshold;
+  } else if constexpr (scoring == MSAC) {
+    const float ratio = distance / threshold;
+    return std::max(0.f, 1 - ratio * ratio);
+  } else {
+    const float complement = std::max(0.f, 1 - distance / threshold);
+    return complement * complement;
+  }
+}
+
+// Label every point with respect to the shape and count the front and back
+// inliers
+template <typename Shape>
+std::pair<uint, uint> classify(const Shape& shape,
+                               const std::vector<Eigen::Vector3f>& points,
+                               const std::vector<Eigen::Vector3f>* normals,
+                               const float threshold, const NormalMode mode,
+                               std::vector<uint8_t>& labels) {
+  const uint size = points.size();
+  labels.resize(size);
+
+  std::atomic<uint> front = 0;
+  std::atomic<uint> back = 0;
+  with_normal_mode(mode, [&](auto m) {
+    default_thread_pool().parallel_for(size, 4096, [&](uint begin, uint end) {
+      uint chunk_front = 0;
+      uint chunk_back = 0;
+      for (uint i = begin; i < end; i++) {
+        const uint8_t label =
+            label_of<m()>(shape, points, normals, threshold, i);
+        labels[i] = label;
+        chunk_front += label == INLIER;
+        chunk_back += label == INLIER_BACKFACE;
+      }
+      front += chunk_front;
+      back += chunk_back;
+    });
+  });
+  return {front, back};
+}
+
+// Front and back scores of the shape over all the points, the number of
+// inliers by default (the back score is 0 unless normals are unoriented)
+template <Scoring scoring, NormalMode mode, typename Shape>
+std::pair<ScoreSum<scoring>, ScoreSum<scoring>> count_inliers(
+    const Shape& shape, const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>* normals, const float threshold) {
+  ScoreSum<scoring> front = 0;
+  ScoreSum<scoring> back = 0;
+  for (uint i = 0; i < points.size(); i++) {
+    const PointScore<scoring> score =
+        point_score<scoring>(shape.distance(points[i]), threshold);
+    const uint8_t side = side_of<mode>(shape, points, normals, i);
+    front += (side == INLIER) * score;
+    if constexpr (mode == UNORIENTED_NORMALS)
+      back += (side == INLIER_BACKFACE) * score;
+  }
+  return {front, back};
+}
+
+// Front and back scores of the shape over the active points of a level
+template <Scoring scoring, NormalMode mode, typename Shape>
+std::pair<ScoreSum<scoring>, ScoreSum<scoring>> count_inliers(
+    const Shape& shape, const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>* normals, const float threshold,
+    const std::vector<uint>& level, const std::vector<uint8_t>& active) {
+  ScoreSum<scoring> front = 0;
+  ScoreSum<scoring> back = 0;
+  for (uint i : level) {
+    const PointScore<scoring> score =
+        active[i] * point_score<scoring>(shape.distance(points[i]), threshold);
+    const uint8_t side = side_of<mode>(shape, points, normals, i);
+    front += (side == INLIER) * score;
+    if constexpr (mode == UNORIENTED_NORMALS)
+      back += (side == INLIER_BACKFACE) * score;
+  }
+  return {front, back};
+}
+
+// Front and back scores of a plane over binned points, only visiting the
+// bins that may hold normals aligned with the plane: the points of the other
+// bins are neither front nor back inliers (with oriented normals, the bins
+// facing away from the plane are skipped as well)
+template <Scoring scoring, NormalMode mode>
+std::pair<ScoreSum<scoring>, ScoreSum<scoring>> count_inliers(
+    const Plane& plane, const NormalIndex& index, const float threshold) {
+  static const float max_angle = std::acos(NORMAL_ALIGNMENT_THRESHOLD);
+  const Eigen::Vector3f normal = plane.plane.normal();
+  ScoreSum<scoring> front = 0;
+  ScoreSum<scoring> back = 0;
+  for (uint b = 0; b < index.bins(); b++) {
+    const bool visit = mode == ORIENTED_NORMALS
+                           ? index.may_face(b, normal, max_angle)
+                           : index.may_align(b, normal, max_angle);
+    if (!visit) continue;
+
+    for (uint i = index.offsets[b]; i < index.offsets[b + 1]; i++) {
+      const PointScore<scoring> score =
+          point_score<scoring>(plane.distance(index.points[i]), threshold);
+      const float alignment = normal.dot(index.normals[i]);
+      front += (alignment > NORMAL_ALIGNMENT_THRESHOLD) * score;
+      if constexpr (mode == UNORIENTED_NORMALS)
+        back += (alignment < -NORMAL_ALIGNMENT_THRESHOLD) * score;
+    }
+  }
+  return {front, back};
+}
+
+// Split the points by their label into inliers and outliers
+void split_labels(const std::vector<uint8_t>& labels,
+                  const uint8_t inliers_label, std::vector<uint>& inliers,
+                  std::vector<uint>& outliers) {
+  inliers.clear();
+  outliers.clear();
+  for (uint i = 0; i < labels.size(); i++) {
+    if (labels[i] == inliers_label)
+      inliers.push_back(i);
+    else
+      outliers.push_back(i);
+  }
+}
+
+// Inliers (on the side with most of them) and outliers of a shape, stored in
+// workspace.inliers and workspace.outliers
+template <typename Shape>
+void verify(const Shape& shape, const std::vector<Eigen::Vector3f>& points,
+            const std::vector<Eigen::Vector3f>* normals, const float threshold,
+            const NormalMode mode, RansacWorkspace& workspace) {
+  auto [front, back] =
+      classify(shape, points, normals, threshold, mode, workspace.labels);
+  split_labels(workspace.labels, front >= back ? INLIER : INLIER_BACKFACE,
+               workspace.inliers, workspace.outliers);
+}
+
+// Score the hypotheses in parallel. count(shape, scoring, mode) returns the
+// front and back scores of a shape, scoring and mode being
+// std::integral_constant so that the loop over the points is compiled for
+// each Scoring and NormalMode, and the score is the largest of them
+template <typename Shape, typename Count>
+void score_hypotheses(std::vector<Hypothesis<Shape>>& hypotheses,
+                      const Scoring scoring, const NormalMode mode,
+                      Count count) {
+  auto score_all = [&](auto scoring_constant, auto mode_constant) {
+    default_thread_pool().parallel_for(
+        hypotheses.size(), 1, [&](uint begin, uint end) {
+          for (uint k = begin; k < end; k++) {
+            auto [front, back] =
+                count(hypotheses[k].shape, scoring_constant, mode_constant);
+            hypotheses[k].score = std::max(front, back);
+          }
+        });
+  };
+
+  with_normal_mode(mode, [&](auto m) {
+    switch (scoring) {
+      case MSAC:
+        score_all(std::integral_constant<Scoring, MSAC>(), m);
+        break;
+      case MAGSAC:
+        score_all(std::integral_constant<Scoring, MAGSAC>(), m);
+        break;
+      default:
+        score_all(std::integral_constant<Scoring, INLIER_COUNT>(), m);
+    }
+  });
+}
+
+// First hypothesis with the highest score, as if they were scored in order
+template <typename Shape>
+const Hypothesis<Shape>& best_hypothesis(
+    const std::vector<Hypothesis<Shape>>& hypotheses) {
+  return *std::max_element(
+      hypotheses.begin(), hypotheses.end(),
+      [](const Hypothesis<Shape>& a, const Hypothesis<Shape>& b) {
+        return a.score < b.score;
+      });
+}
+
+bool parse_scoring(const std::string& name, Scoring& scoring) {
+  if (name == "count")
+    scoring = INLIER_COUNT;
+  else if (name == "msac")
+    scoring = MSAC;
+  else if (name == "magsac")
+    scoring = MAGSAC;
+  else
+    return false;
+  return true;
+}
+
+// Whether the radius of the shape is at most max_radius (0 for no bound),
+// planes have no radius
+template <typename Shape>
+bool within_radius(const Shape& shape, const float max_radius) {
+  if constexpr (std::is_same_v<Shape, Plane>)
+    return true;
+  else
+    return max_radius <= 0 || shape.radius <= max_radius;
+}
+
+// Ransac for the detection of one Shape (Plane, Sphere or Cylinder) in 3D
+// The samples are drawn first (in the same order as a sequential search) and
+// the hypotheses are then scored in parallel
+template <typename Shape>
+std::optional<Shape> fit_shape(const std::vector<Eigen::Vector3f>& points,
+                               const std::vector<Eigen::Vector3f>* normals,
+                               const float threshold,
+                               const uint max_number_of_iterations,
+                               bool remove_outliers,
+                               RansacWorkspace& workspace,
+                               Scoring scoring,
+                               const NormalIndex* normal_index,
+                               bool oriented_normals, float max_radius) {
+  if (points.size() < Shape::sample_size) return std::nullopt;
+  if (Shape::needs_normals && normals == nullptr) return std::nullopt;
+
+  std::array<Eigen::Vector3f, Shape::sample_size> samples;
+  std::array<Eigen::Vector3f, Shape::sample_size> samples_normals;
+
+  std::vector<Hypothesis<Shape>>& hypotheses =
+      std::get<std::vector<Hypothesis<Shape>>>(workspace.hypotheses);
+  hypotheses.clear();
+
+  for (uint k = 0; k < max_number_of_iterations; k++) {
+    for (uint j = 0; j < Shape::sample_size; j++) {
+      uint index = workspace.rng() % points.size();
+      samples[j] = points[index];
+      if (normals != nullptr) samples_normals[j] = (*normals)[index];
+    }
+
+    std::optional<Shape> shape =
+        Shape::fit(samples, normals != nullptr ? &samples_normals : nullptr);
+    if (shape.has_value() && within_radius(*shape, max_radius))
+      hypotheses.push_back({*shape, 0});
+  }
+
+  if (hypotheses.empty()) return std::nullopt;
+
+  const NormalMode mode = normal_mode(normals, oriented_normals);
+  score_hypotheses(
+      hypotheses, scoring, mode, [&](const Shape& shape, auto s, auto m) {
+        if constexpr (std::is_same_v<Shape, Plane> && m() != NO_NORMALS)
+          if (normal_index != nullptr)
+            return count_inliers<s(), m()>(shape, *normal_index, threshold);
+        return count_inliers<s(), m()>(shape, points, normals, threshold);
+      });
+  const Shape best_shape = best_hypothesis(hypotheses).shape;
+
+  verify(best_shape, points, normals, threshold, mode, workspace);
+
+  if (remove_outliers)
+    std::tie(workspace.inliers, workspace.outliers) =
+        outliers_removal(points, workspace.inliers, workspace.outliers);
+  return best_shape;
+}
+
+template <typename Shape>
+std::optional<ShapeFit<Shape>> fit_shape(
     const std::vector<Eigen::Vector3f>& points, const float threshold,
     const uint max_number_of_iterations,
     const std::optional<std::vector<Eigen::Vector3f>>& normals,
     bool remove_outliers) {
-  std::vector<uint> best_inliers;
-  std::vector<uint> best_outliers;
+  RansacWorkspace workspace(std::rand());
+  std::optional<Shape> shape = fit_shape<Shape>(
+      points, normals.has_value() ? &normals.value() : nullptr, threshold,
+      max_number_of_iterations, remove_outliers, workspace);
 
-  for (uint k = 0; k < max_number_of_iterations; k++) {
-    uint a = std::rand() % points.size();
-    uint b = std::rand() % points.size();
-    uint c = std::rand() % points.size();
-
-    // Create Eigen plane
-    Eigen::Hyperplane<float, 3> plane =
-        Eigen::Hyperplane<float, 3>::Through(points[a], points[b], points[c]);
-
-    std::vector<uint> inliers;
-    std::vector<uint> inliers_backface;
-    std::vector<uint> outliers;
-
-    // Find inliers
-    for (uint i = 0; i < points.size(); i++) {
-      // Check if point is close enough to plane
-      if (plane.absDistance(points[i]) <= threshold) {
-        // If normals are given, check if normal is aligned
-        if (normals.has_value()) {
-          float normal_alignment = plane.normal().dot(normals.value()[i]);
-
-          if (normal_alignment > NORMAL_ALIGNMENT_THRESHOLD) {
-            inliers.push_back(i);
-          } else if (normal_alignment < -NORMAL_ALIGNMENT_THRESHOLD) {
-            inliers_backface.push_back(i);
-          } else {
-            outliers.push_back(i);
-          }
-        } else {
-          inliers.push_back(i);
-        }
+  if (!shape.has_value()) return std::nullopt;
+  return ShapeFit<Shape>{*shape, std::move(workspace.inliers),
+                         std::move(workspace.outliers)};
+}
+
+// Coarse-to-fine ransac over the levels of a pyramid: hypotheses are scored
+// on the coarsest level and only the best ones are rescored on each finer
+// level (half of them at each level). Returns the best hypothesis on level 1,
+// its verification on the full cloud is left to the caller.
+template <typename Shape>
+std::optional<Hypothesis<Shape>> fit_shape_hierarchical(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>* normals, const Pyramid& pyramid,
+    const std::vector<uint8_t>& active, const RansacParams& params,
+    const float max_radius, RansacWorkspace& workspace) {
+  if (Shape::needs_normals && normals == nullptr) return std::nullopt;
+
+  const std::vector<uint>& coarsest = pyramid.levels.back();
+  std::array<Eigen::Vector3f, Shape::sample_size> samples;
+  std::array<Eigen::Vector3f, Shape::sample_size> samples_normals;
+
+  std::vector<Hypothesis<Shape>>& hypotheses =
+      std::get<std::vector<Hypothesis<Shape>>>(workspace.hypotheses);
+  hypotheses.clear();
+
+  for (uint k = 0; k < params.max_number_of_iterations; k++) {
+    bool sampled = true;
+    for (uint j = 0; j < Shape::sample_size && sampled; j++) {
+      // Removed points are masked, retry a few times to find an active one
+      uint index = coarsest[workspace.rng() % coarsest.size()];
+      for (uint attempt = 0; !active[index] && attempt < 64; attempt++)
+        index = coarsest[workspace.rng() % coarsest.size()];
+
+      sampled = active[index];
+      samples[j] = points[index];
+      if (normals != nullptr) samples_normals[j] = (*normals)[index];
+    }
+    if (!sampled) continue;
+
+    std::optional<Shape> shape =
+        Shape::fit(samples, normals != nullptr ? &samples_normals : nullptr);
+    if (!shape.has_value() || !within_radius(*shape, max_radius)) continue;
+
+    hypotheses.push_back({*shape, 0});
+  }
+
+  if (hypotheses.empty()) return std::nullopt;
+
+  const NormalMode mode = normal_mode(normals, params.oriented_normals);
+  score_hypotheses(hypotheses, params.scoring, mode,
+                   [&](const Shape& shape, auto s, auto m) {
+                     return count_inliers<s(), m()>(shape, points, normals,
+                                                    params.threshold,
+                                                    coarsest, active);
+                   });
+
+  auto better = [](const Hypothesis<Shape>& a, const Hypothesis<Shape>& b) {
+    return a.score > b.score;
+  };
+
+  uint survivors = std::max(1u, params.pyramid_survivors);
+  for (uint level = pyramid.levels.size() - 1; level > 0; level--) {
+    if (level < pyramid.levels.size() - 1) {
+      score_hypotheses(hypotheses, params.scoring, mode,
+                       [&](const Shape& shape, auto s, auto m) {
+                         return count_inliers<s(), m()>(
+                             shape, points, normals, params.threshold,
+                             pyramid.levels[level], active);
+                       });
+    }
+
+    const uint kept = std::min<uint>(survivors, hypotheses.size());
+    std::partial_sort(hypotheses.begin(), hypotheses.begin() + kept,
+                      hypotheses.end(), better);
+    hypotheses.resize(kept);
+    survivors = std::max(1u, survivors / 2);
+  }
+
+  return hypotheses.front();
+}
+
+// Front and back scores of the shape over a quantized cloud. Planes are
+// expressed in the frame of each tile so that the inner loop only converts
+// the 16-bit coordinates, other shapes decode the points.
+template <Scoring scoring, NormalMode mode, typename Shape>
+std::pair<ScoreSum<scoring>, ScoreSum<scoring>> count_inliers(
+    const Shape& shape, const QuantizedCloud& cloud, const float threshold) {
+  const int16_t* x = cloud.coordinates[0].data();
+  const int16_t* y = cloud.coordinates[1].data();
+  const int16_t* z = cloud.coordinates[2].data();
+  const uint16_t* normals = cloud.normals.data();
+  constexpr float squared_threshold =
+      NORMAL_ALIGNMENT_THRESHOLD * NORMAL_ALIGNMENT_THRESHOLD;
+
+  ScoreSum<scoring> front = 0;
+  ScoreSum<scoring> back = 0;
+  for (uint t = 0; t < cloud.tiles.size(); t++) {
+    const QuantizedCloud::Tile& tile = cloud.tiles[t];
+    const uint begin = t * QuantizedCloud::tile_size;
+    const uint end =
+        std::min<uint>(cloud.size(), begin + QuantizedCloud::tile_size);
+
+    Eigen::Vector3f tile_normal;
+    float tile_offset = 0;
+    if constexpr (std::is_same_v<Shape, Plane>) {
+      tile_normal = shape.plane.normal().cwiseProduct(tile.scale);
+      tile_offset = shape.plane.signedDistance(tile.origin);
+    }
+
+    for (uint i = begin; i < end; i++) {
+      float distance;
+      Eigen::Vector3f normal;
+      if constexpr (std::is_same_v<Shape, Plane>) {
+        distance = std::abs(tile_normal.x() * x[i] + tile_normal.y() * y[i] +
+                            tile_normal.z() * z[i] + tile_offset);
+        normal = shape.plane.normal();
       } else {
-        outliers.push_back(i);
+        const Eigen::Vector3f p = cloud[i];
+        distance = shape.distance(p);
+        normal = shape.normal_at(p);
       }
-    }
 
-    // Check if new plane has more inliers
-    if (inliers.size() > best_inliers.size()) {
-      best_inliers = inliers;
-      best_outliers = merge(inliers_backface, outliers);
+      const PointScore<scoring> score =
+          point_score<scoring>(distance, threshold);
+      if constexpr (mode == NO_NORMALS) {
+        front += score;
+      } else {
+        // The alignment d / |n| is compared through d |d| and |n|^2
+        const Eigen::Vector3f n = QuantizedCloud::scaled_normal(normals[i]);
+        const float d = normal.dot(n);
+        const float bound = squared_threshold * n.squaredNorm();
+        front += (d * std::abs(d) > bound) * score;
+        if constexpr (mode == UNORIENTED_NORMALS)
+          back += (d * std::abs(d) < -bound) * score;
+      }
     }
-    if (inliers_backface.size() > best_inliers.size()) {
-      best_inliers = inliers_backface;
-      best_outliers = merge(inliers, outliers);
+  }
+  return {front, back};
+}
+
+template <typename Shape>
+std::optional<Hypothesis<Shape>> fit_shape_quantized(
+    const QuantizedCloud& cloud, const RansacParams& params,
+    const float max_radius, RansacWorkspace& workspace) {
+  if (cloud.size() < Shape::sample_size) return std::nullopt;
+  if (Shape::needs_normals && !cloud.has_normals()) return std::nullopt;
+
+  std::array<Eigen::Vector3f, Shape::sample_size> samples;
+  std::array<Eigen::Vector3f, Shape::sample_size> samples_normals;
+
+  std::vector<Hypothesis<Shape>>& hypotheses =
+      std::get<std::vector<Hypothesis<Shape>>>(workspace.hypotheses);
+  hypotheses.clear();
+
+  for (uint k = 0; k < params.max_number_of_iterations; k++) {
+    for (uint j = 0; j < Shape::sample_size; j++) {
+      const uint index = workspace.rng() % cloud.size();
+      samples[j] = cloud[index];
+      if (cloud.has_normals()) samples_normals[j] = cloud.normal(index);
     }
+
+    std::optional<Shape> shape = Shape::fit(
+        samples, cloud.has_normals() ? &samples_normals : nullptr);
+    if (shape.has_value() && within_radius(*shape, max_radius))
+      hypotheses.push_back({*shape, 0});
   }
 
-  if (remove_outliers)
-    return outliers_removal(points, best_inliers, best_outliers);
-  return {best_inliers, best_outliers};
+  if (hypotheses.empty()) return std::nullopt;
+
+  const NormalMode mode = !cloud.has_normals() ? NO_NORMALS
+                         : params.oriented_normals ? ORIENTED_NORMALS
+                                                   : UNORIENTED_NORMALS;
+  score_hypotheses(hypotheses, params.scoring, mode,
+                   [&](const Shape& shape, auto s, auto m) {
+                     return count_inliers<s(), m()>(shape, cloud,
+                                                    params.threshold);
+                   });
+  return best_hypothesis(hypotheses);
 }
 
-std::vector<std::vector<Eigen::Vector3f>> ransac_multi(
+// Ransac for plane detection in 3D (or any other Shape)
+template <typename Shape>
+std::pair<std::vector<uint>, std::vector<uint>> ransac(
     const std::vector<Eigen::Vector3f>& points, const float threshold,
-    const uint max_number_of_iterations, const uint max_objects,
-    const float min_inliers_ratio,
+    const uint max_number_of_iterations,
     const std::optional<std::vector<Eigen::Vector3f>>& normals,
     bool remove_outliers) {
-  std::vector<std::vector<Eigen::Vector3f>> objects;
-  std::vector<Eigen::Vector3f> remaining_points = points;
-  std::optional<std::vector<Eigen::Vector3f>> remaining_normals = normals;
+  std::optional<ShapeFit<Shape>> fit = fit_shape<Shape>(
+      points, threshold, max_number_of_iterations, normals, remove_outliers);
+
+  if (!fit.has_value()) {
+    std::vector<uint> outliers(points.size());
+    std::iota(outliers.begin(), outliers.end(), 0);
+    return {{}, outliers};
+  }
+  return {fit->inliers, fit->outliers};
+}
+
+#define INSTANTIATE_RANSAC(Shape)                                          \
+  template std::optional<Shape> fit_shape<Shape>(                          \
+      const std::vector<Eigen::Vector3f>&,                                 \
+      const std::vector<Eigen::Vector3f>*, const float, const uint, bool,  \
+      RansacWorkspace&, Scoring, const NormalIndex*, bool, float);         \
+  template std::optional<ShapeFit<Shape>> fit_shape<Shape>(                \
+      const std::vector<Eigen::Vector3f>&, const float, const uint,        \
+      const std::optional<std::vector<Eigen::Vector3f>>&, bool);           \
+  template std::pair<std::vector<uint>, std::vector<uint>> ransac<Shape>( \
+      const std::vector<Eigen::Vector3f>&, const float, const uint,        \
+      const std::optional<std::vector<Eigen::Vector3f>>&, bool);
+
+INSTANTIATE_RANSAC(Plane)
+INSTANTIATE_RANSAC(Sphere)
+INSTANTIATE_RANSAC(Cylinder)
+
+// Add an object made of the given indices, reusing the buffers of the
+// objects left by a previous call
+void add_object(Detection& detection, uint& objects_count,
+                const AnyShape& shape, const std::vector<uint>& indices) {
+  if (objects_count == detection.objects.size())
+    detection.objects.emplace_back();
+  DetectedObject& object = detection.objects[objects_count++];
+  object.shape = shape;
+  object.indices.assign(indices.begin(), indices.end());
+}
+
+// Remove and return the seed with most inliers among the points if it has at
+// least min_inliers of them, otherwise no seed is supported anymore and they
+// are all removed. Seeds of shapes not in the shapes flags are ignored.
+std::optional<AnyShape> take_seed(const std::vector<Eigen::Vector3f>& points,
+                                  const std::vector<Eigen::Vector3f>* normals,
+                                  const float threshold, const NormalMode mode,
+                                  const uint shapes, const uint min_inliers,
+                                  RansacWorkspace& workspace) {
+  std::vector<AnyShape>& seeds = workspace.seeds;
+  uint best_seed = 0;
+  uint best_score = 0;
+  for (uint k = 0; k < seeds.size(); k++) {
+    const uint score = std::visit(
+        [&](const auto& shape) -> uint {
+          if (!(shapes & shape.flag)) return 0;
+          auto [front, back] = classify(shape, points, normals, threshold,
+                                        mode, workspace.labels);
+          return std::max(front, back);
+        },
+        seeds[k]);
+    if (score > best_score) {
+      best_seed = k;
+      best_score = score;
+    }
+  }
+
+  if (best_score == 0 || best_score < min_inliers) {
+    seeds.clear();
+    return std::nullopt;
+  }
+  const AnyShape seed = seeds[best_seed];
+  seeds.erase(seeds.begin() + best_seed);
+  return seed;
+}
+
+// Number of bits set in bits and not in mask
+uint count_and_not(const std::vector<uint64_t>& bits,
+                   const std::vector<uint64_t>& mask) {
+  uint count = 0;
+  for (uint w = 0; w < bits.size(); w++)
+    count += __builtin_popcountll(bits[w] & ~mask[w]);
+  return count;
+}
+
+// Give the bitsets of the cached hypotheses back to the workspace, to be
+// reused by the next ones instead of allocating theirs
+void recycle_bitsets(std::vector<CachedHypothesis>::iterator first,
+                     std::vector<CachedHypothesis>::iterator last,
+                     RansacWorkspace& workspace) {
+  for (auto cached = first; cached != last; ++cached)
+    for (auto* bits : {&cached->front_bits, &cached->back_bits})
+      if (bits->capacity() > 0)
+        workspace.spare_bitsets.push_back(std::move(*bits));
+}
+
+// Spare bitset of the workspace, empty if there is none
+std::vector<uint64_t> take_bitset(RansacWorkspace& workspace) {
+  if (workspace.spare_bitsets.empty()) return {};
+  std::vector<uint64_t> bits = std::move(workspace.spare_bitsets.back());
+  workspace.spare_bitsets.pop_back();
+  return bits;
+}
+
+// Bitsets (over size points) of the front and back inliers of the shape
+// among the remaining points
+template <typename Shape>
+void inlier_bitsets(const Shape& shape,
+                    const std::vector<Eigen::Vector3f>& remaining_points,
+                    const std::vector<Eigen::Vector3f>* remaining_normals,
+                    const std::vector<uint>& remaining, const float threshold,
+                    const NormalMode mode, const uint size,
+                    CachedHypothesis& cached) {
+  cached.front_bits.assign((size + 63) / 64, 0);
+  cached.back_bits.assign((size + 63) / 64, 0);
+  with_normal_mode(mode, [&](auto m) {
+    for (uint j = 0; j < remaining.size(); j++) {
+      const uint8_t label = label_of<m()>(shape, remaining_points,
+                                          remaining_normals, threshold, j);
+      const uint i = remaining[j];
+      cached.front_bits[i / 64] |= uint64_t(label == INLIER) << (i % 64);
+      cached.back_bits[i / 64] |= uint64_t(label == INLIER_BACKFACE)
+                                  << (i % 64);
+    }
+  });
+}
+
+// Keep the best distinct hypotheses of the last search in the cache with their
+// inliers among the remaining points, skipping those similar to the winner of
+// the round or to a better hypothesis. The cache keeps the
+// hypothesis_cache_size best.
+void update_hypothesis_cache(
+    const AnyShape& winner,
+    const std::vector<Eigen::Vector3f>& remaining_points,
+    const std::vector<Eigen::Vector3f>* remaining_normals,
+    const std::vector<uint>& remaining, const uint size,
+    const RansacParams& params, RansacWorkspace& workspace) {
+  std::vector<CachedHypothesis>& cache = workspace.hypothesis_cache;
+  std::vector<CachedHypothesis>& candidates = workspace.cache_candidates;
+  const NormalMode mode =
+      normal_mode(remaining_normals, params.oriented_normals);
+
+  candidates.clear();
+  std::apply(
+      [&](const auto&... hypotheses) {
+        (..., [&] {
+          for (const auto& hypothesis : hypotheses)
+            candidates.push_back(
+                {hypothesis.shape, hypothesis.score, 0, 0, {}, {}});
+        }());
+      },
+      workspace.hypotheses);
+  std::sort(candidates.begin(), candidates.end(),
+            [](const CachedHypothesis& a, const CachedHypothesis& b) {
+              return a.score > b.score;
+            });
+
+  auto is_new = [&](const AnyShape& shape, uint selected) {
+    if (similar(shape, winner, params.cache_min_alignment, params.threshold))
+      return false;
+    for (uint k = 0; k < selected; k++)
+      if (similar(shape, candidates[k].shape, params.cache_min_alignment,
+                  params.threshold))
+        return false;
+    for (const CachedHypothesis& cached : cache)
+      if (similar(shape, cached.shape, params.cache_min_alignment,
+                  params.threshold))
+        return false;
+    return true;
+  };
+
+  uint selected = 0;
+  for (uint k = 0; k < candidates.size(); k++) {
+    if (selected == params.hypothesis_cache_size) break;
+    if (is_new(candidates[k].shape, selected))
+      std::swap(candidates[selected++], candidates[k]);
+  }
+  candidates.resize(selected);
+  if (params.cache_bitsets)
+    for (CachedHypothesis& candidate : candidates) {
+      candidate.front_bits = take_bitset(workspace);
+      candidate.back_bits = take_bitset(workspace);
+    }
+
+  default_thread_pool().parallel_for(
+      candidates.size(), 1, [&](uint begin, uint end) {
+        for (uint k = begin; k < end; k++) {
+          CachedHypothesis& candidate = candidates[k];
+          if (!params.cache_bitsets) {
+            std::tie(candidate.front, candidate.back) = std::visit(
+                [&](const auto& shape) {
+                  return with_normal_mode(mode, [&](auto m) {
+                    return count_inliers<INLIER_COUNT, m()>(
+                        shape, remaining_points, remaining_normals,
+                        params.threshold);
+                  });
+                },
+                candidate.shape);
+            continue;
+          }
+
+          std::visit(
+              [&](const auto& shape) {
+                inlier_bitsets(shape, remaining_points, remaining_normals,
+                               remaining, params.threshold, mode, size,
+                               candidate);
+              },
+              candidate.shape);
+          candidate.front = count_and_not(candidate.front_bits,
+                                          workspace.removed_bits);
+          candidate.back =
+              count_and_not(candidate.back_bits, workspace.removed_bits);
+        }
+      });
+
+  cache.insert(cache.end(), std::make_move_iterator(candidates.begin()),
+               std::make_move_iterator(candidates.end()));
+  std::sort(cache.begin(), cache.end(),
+            [](const CachedHypothesis& a, const CachedHypothesis& b) {
+              return std::max(a.front, a.back) > std::max(b.front, b.back);
+            });
+  if (cache.size() > params.hypothesis_cache_size) {
+    recycle_bitsets(cache.begin() + params.hypothesis_cache_size, cache.end(),
+                    workspace);
+    cache.resize(params.hypothesis_cache_size);
+  }
+}
+
+// Subtract the points of the objects (first, last( from the inliers of the
+// cached hypotheses, the hypotheses similar to these objects are removed
+void subtract_from_hypothesis_cache(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>* normals, const RansacParams& params,
+    const Detection& detection, const uint first, const uint last,
+    RansacWorkspace& workspace) {
+  std::vector<CachedHypothesis>& cache = workspace.hypothesis_cache;
+  const NormalMode mode = normal_mode(normals, params.oriented_normals);
+
+  auto is_removed = [&](const CachedHypothesis& cached) {
+    for (uint o = first; o < last; o++)
+      if (similar(cached.shape, detection.objects[o].shape,
+                  params.cache_min_alignment, params.threshold))
+        return true;
+    return false;
+  };
+
+  if (params.cache_bitsets) {
+    // The counts are those of the bitsets without the removed points
+    for (uint o = first; o < last; o++)
+      for (uint i : detection.objects[o].indices)
+        workspace.removed_bits[i / 64] |= uint64_t(1) << (i % 64);
+
+    default_thread_pool().parallel_for(
+        cache.size(), 1, [&](uint begin, uint end) {
+          for (uint k = begin; k < end; k++) {
+            CachedHypothesis& cached = cache[k];
+            if (is_removed(cached)) {
+              cached.front = cached.back = 0;
+              continue;
+            }
+            cached.front =
+                count_and_not(cached.front_bits, workspace.removed_bits);
+            cached.back =
+                count_and_not(cached.back_bits, workspace.removed_bits);
+          }
+        });
+  } else {
+    // The removed points are classified to subtract them from the counts
+    default_thread_pool().parallel_for(
+        cache.size(), 1, [&](uint begin, uint end) {
+          for (uint k = begin; k < end; k++) {
+            CachedHypothesis& cached = cache[k];
+            if (is_removed(cached)) {
+              cached.front = cached.back = 0;
+              continue;
+            }
+            std::visit(
+                [&](const auto& shape) {
+                  with_normal_mode(mode, [&](auto m) {
+                    for (uint o = first; o < last; o++) {
+                      for (uint i : detection.objects[o].indices) {
+                        const uint8_t label = label_of<m()>(
+                            shape, points, normals, params.threshold, i);
+                        cached.front -= label == INLIER;
+                        cached.back -= label == INLIER_BACKFACE;
+                      }
+                    }
+                  });
+                },
+                cached.shape);
+          }
+        });
+  }
+
+  // The kept hypotheses are swapped to the front in order, so that the
+  // bitsets of the removed ones are recycled rather than freed
+  auto removed = cache.begin();
+  for (auto cached = cache.begin(); cached != cache.end(); ++cached)
+    if (cached->front != 0 || cached->back != 0)
+      std::iter_swap(removed++, cached);
+  recycle_bitsets(removed, cache.end(), workspace);
+  cache.erase(removed, cache.end());
+}
+
+// Remove and return the cached hypothesis with most inliers if it has at
+// least min_inliers of them
+std::optional<AnyShape> take_cached_hypothesis(const uint min_inliers,
+                                               RansacWorkspace& workspace) {
+  std::vector<CachedHypothesis>& cache = workspace.hypothesis_cache;
+  auto best = std::max_element(
+      cache.begin(), cache.end(),
+      [](const CachedHypothesis& a, const CachedHypothesis& b) {
+        return std::max(a.front, a.back) < std::max(b.front, b.back);
+      });
+  if (best == cache.end() || std::max(best->front, best->back) < min_inliers)
+    return std::nullopt;
+
+  const AnyShape shape = best->shape;
+  recycle_bitsets(best, best + 1, workspace);
+  cache.erase(best);
+  return shape;
+}
+
+void ransac_multi(const std::vector<Eigen::Vector3f>& points,
+                  const std::vector<Eigen::Vector3f>* normals,
+                  const RansacParams& params, RansacWorkspace& workspace,
+                  Detection& detection) {
+  // Shapes detected in the previous frame
+  workspace.seeds.clear();
+  if (params.warm_start)
+    for (const DetectedObject& object : detection.objects)
+      workspace.seeds.push_back(object.shape);
+
+  recycle_bitsets(workspace.hypothesis_cache.begin(),
+                  workspace.hypothesis_cache.end(), workspace);
+  workspace.hypothesis_cache.clear();
+  if (params.hypothesis_cache_size > 0 && params.cache_bitsets)
+    workspace.removed_bits.assign((points.size() + 63) / 64, 0);
+
+  uint objects_count = 0;
+
+  std::vector<uint>& remaining = workspace.remaining;
+  remaining.resize(points.size());
+  std::iota(remaining.begin(), remaining.end(), 0);
+
+  std::vector<Eigen::Vector3f>& remaining_points = workspace.remaining_points;
+  remaining_points.assign(points.begin(), points.end());
+  const std::vector<Eigen::Vector3f>* remaining_normals = nullptr;
+  if (normals != nullptr) {
+    workspace.remaining_normals.assign(normals->begin(), normals->end());
+    remaining_normals = &workspace.remaining_normals;
+  }
+
+  const SharedIndex* shared = workspace.shared_index;
+  const NormalMode mode = normal_mode(normals, params.oriented_normals);
+
+  // Bound on the radius of the spheres and cylinders
+  float max_radius = params.max_radius;
+  if (max_radius <= 0 && (params.shapes & (SPHERE | CYLINDER))) {
+    Eigen::AlignedBox<float, 3> box;
+    for (const Eigen::Vector3f& p : points) box.extend(p);
+    max_radius = box.diagonal().norm();
+  }
+
+  // Spatial index used to split the objects into connected components and to
+  // build the pyramid
+  const KdTree* kdtree = &workspace.kdtree;
+  if (params.connectivity_radius > 0 || params.pyramid_levels > 1) {
+    if (shared != nullptr && shared->kdtree.m_root != nullptr)
+      kdtree = &shared->kdtree;
+    else
+      workspace.kdtree.build(points);
+  }
+  if (params.connectivity_radius > 0)
+    workspace.slots.assign(points.size(), -1);
+
+  // Coarse-to-fine search over a pyramid of the points
+  const Pyramid* pyramid = &workspace.pyramid;
+  workspace.pyramid.levels.clear();
+  if (params.pyramid_levels > 1) {
+    if (shared != nullptr && shared->pyramid_levels == params.pyramid_levels &&
+        shared->pyramid_factor == params.pyramid_factor)
+      pyramid = &shared->pyramid;
+    else
+      workspace.pyramid.build(*kdtree, params.pyramid_levels,
+                              params.pyramid_factor);
+  }
+  const bool hierarchical = pyramid->levels.size() > 1;
+
+  // Otherwise hypotheses may be searched on the voxels of the remaining points
+  const bool coarse = !hierarchical && params.voxel_size > 0;
+
+  // Or on a 16-bit quantized copy of the remaining points, made at each
+  // round so that the removed points are never scanned
+  const bool quantized = !hierarchical && !coarse && params.quantize;
+
+  // The pyramid is built once, the points removed by the previous rounds are
+  // masked out
+  std::vector<uint8_t>& active = workspace.active;
+  if (hierarchical)
+    active.assign(points.size(), 1);
+  else
+    active.clear();
 
   float inliers_ratio = 1.0;
 
-  while (objects.size() < max_objects && inliers_ratio >= min_inliers_ratio) {
-    if (remaining_points.size() == 0) return objects;
+  while (objects_count < params.max_objects &&
+         inliers_ratio >= params.min_inliers_ratio) {
+    if (remaining_points.size() == 0) break;
+
+    // Every selected shape competes, the one with most inliers wins. The
+    // inliers and outliers of the winner are kept in best_inliers and
+    // best_outliers (swapped with the workspace buffers)
+    std::optional<AnyShape> best_shape;
+    std::vector<uint> best_inliers;
+    std::vector<uint> best_outliers;
+    std::swap(best_inliers, workspace.object_indices);
+    std::swap(best_outliers, workspace.next_remaining);
+
+    // The shapes of the previous frame are tried first, then the hypotheses
+    // cached by the previous rounds. The random search only runs once none
+    // of them is supported by the remaining points
+    const uint min_inliers =
+        std::ceil(params.min_inliers_ratio * points.size());
+    if (!workspace.seeds.empty())
+      best_shape = take_seed(remaining_points, remaining_normals,
+                             params.threshold, mode, params.shapes,
+                             min_inliers, workspace);
+    if (!best_shape.has_value())
+      best_shape = take_cached_hypothesis(min_inliers, workspace);
+    const bool reused = best_shape.has_value();
+
+    // Hypotheses of the shapes that are not searched must not be cached
+    std::apply([](auto&... hypotheses) { (..., hypotheses.clear()); },
+               workspace.hypotheses);
+
+    if (reused) {
+      // Refined and verified below
+    } else if (hierarchical || quantized) {
+      // Only the best hypothesis is returned, it is verified below
+      double best_score = 0;
+      auto compete = [&](auto hypothesis) {
+        if (!hypothesis.has_value()) return;
+        if (best_shape.has_value() && hypothesis->score <= best_score) return;
+        best_shape = hypothesis->shape;
+        best_score = hypothesis->score;
+      };
+
+      auto search = [&](auto shape) {
+        using Shape = decltype(shape);
+        if (hierarchical)
+          return fit_shape_hierarchical<Shape>(points, normals, *pyramid,
+                                               active, params, max_radius,
+                                               workspace);
+        return fit_shape_quantized<Shape>(workspace.quantized_cloud, params,
+                                          max_radius, workspace);
+      };
+
+      if (quantized)
+        workspace.quantized_cloud.build(remaining_points, remaining_normals);
+
+      if (params.shapes & PLANE) compete(search(Plane{}));
+      if (params.shapes & SPHERE) compete(search(Sphere{}));
+      if (params.shapes & CYLINDER) compete(search(Cylinder{}));
+    } else {
+      auto compete = [&](auto shape) {
+        if (!shape.has_value()) return;
+        if (best_shape.has_value() &&
+            workspace.inliers.size() <= best_inliers.size())
+          return;
+        best_shape = *shape;
+        std::swap(best_inliers, workspace.inliers);
+        std::swap(best_outliers, workspace.outliers);
+      };
+
+      if (coarse)
+        voxel_downsample(remaining_points, remaining_normals,
+                         params.voxel_size, workspace.coarse_points,
+                         workspace.coarse_normals);
+
+      const std::vector<Eigen::Vector3f>& search_points =
+          coarse ? workspace.coarse_points : remaining_points;
+      const std::vector<Eigen::Vector3f>* search_normals =
+          coarse && normals != nullptr ? &workspace.coarse_normals
+                                       : remaining_normals;
+      const bool search_remove_outliers = params.remove_outliers && !coarse;
+
+      const NormalIndex* normal_index = nullptr;
+      if (params.normal_bins > 0 && search_normals != nullptr &&
+          (params.shapes & PLANE)) {
+        workspace.normal_index.build(search_points, *search_normals,
+                                     params.normal_bins);
+        normal_index = &workspace.normal_index;
+      }
 
-    std::pair<std::vector<uint>, std::vector<uint>> indexes =
-        ransac(remaining_points, threshold, max_number_of_iterations,
-               remaining_normals, remove_outliers);
+      auto search = [&](auto shape) {
+        using Shape = decltype(shape);
+        return fit_shape<Shape>(search_points, search_normals,
+                                params.threshold,
+                                params.max_number_of_iterations,
+                                search_remove_outliers, workspace,
+                                params.scoring, normal_index,
+                                params.oriented_normals, max_radius);
+      };
 
-    std::vector<Eigen::Vector3f> inliers;
-    std::vector<Eigen::Vector3f> outliers;
-    std::vector<Eigen::Vector3f> outliers_normals =
-        std::vector<Eigen::Vector3f>();
+      if (params.shapes & PLANE) compete(search(Plane{}));
+      if (params.shapes & SPHERE) compete(search(Sphere{}));
+      if (params.shapes & CYLINDER) compete(search(Cylinder{}));
+    }
 
-    for (uint i : indexes.first) {
-      inliers.push_back(remaining_points[i]);
+    if (!best_shape.has_value()) {
+      std::swap(best_inliers, workspace.object_indices);
+      std::swap(best_outliers, workspace.next_remaining);
+      break;
     }
 
-    for (uint i : indexes.second) {
-      outliers.push_back(remaining_points[i]);
-      if (remaining_normals.has_value())
-        outliers_normals.push_back(remaining_normals.value()[i]);
+    if (!reused && params.hypothesis_cache_size > 0)
+      update_hypothesis_cache(*best_shape, remaining_points, remaining_normals,
+                              remaining, points.size(), params, workspace);
+
+    if (reused || coarse || hierarchical || quantized) {
+      // The winner is classified and refined once on the full resolution
+      // remaining points
+      std::visit(
+          [&](auto shape) {
+            verify(shape, remaining_points, remaining_normals,
+                   params.threshold, mode, workspace);
+            shape.refine(remaining_points, workspace.inliers);
+            verify(shape, remaining_points, remaining_normals,
+                   params.threshold, mode, workspace);
+            best_shape = shape;
+            std::swap(best_inliers, workspace.inliers);
+            std::swap(best_outliers, workspace.outliers);
+          },
+          *best_shape);
+
+      if (params.remove_outliers)
+        std::tie(best_inliers, best_outliers) =
+            outliers_removal(remaining_points, best_inliers, best_outliers);
     }
 
-    inliers_ratio = float(inliers.size()) / points.size();
+    // From now on, best_inliers and best_outliers hold indices into points
+    for (uint& i : best_inliers) i = remaining[i];
+    for (uint& i : best_outliers) i = remaining[i];
+
+    inliers_ratio = float(best_inliers.size()) / points.size();
+    const uint first_new_object = objects_count;
+
+    if (inliers_ratio < params.min_inliers_ratio) {
+      // not accepted
+    } else if (params.connectivity_radius > 0) {
+      // Split the inliers into connected components, the largest one (or
+      // every large enough one) becomes an object, the others go back to the
+      // remaining points
+      std::vector<std::vector<uint>> components =
+          connected_components(points, *kdtree, best_inliers,
+                               params.connectivity_radius, workspace.slots);
+
+      inliers_ratio = components.empty()
+                          ? 0
+                          : float(components.front().size()) / points.size();
 
-    if (inliers_ratio >= min_inliers_ratio) {
-      objects.push_back(inliers);
-      remaining_points = outliers;
-      if (remaining_normals.has_value()) remaining_normals = outliers_normals;
+      for (uint c = 0; c < components.size(); c++) {
+        if (inliers_ratio < params.min_inliers_ratio) break;
+
+        const float component_ratio =
+            float(components[c].size()) / points.size();
+        const bool keep =
+            c == 0 || (params.keep_all_components &&
+                       objects_count < params.max_objects &&
+                       component_ratio >= params.min_inliers_ratio);
+        if (keep)
+          add_object(detection, objects_count, *best_shape, components[c]);
+        else
+          best_outliers.insert(best_outliers.end(), components[c].begin(),
+                               components[c].end());
+      }
+    } else {
+      add_object(detection, objects_count, *best_shape, best_inliers);
     }
+
+    std::swap(best_inliers, workspace.object_indices);
+    std::swap(best_outliers, workspace.next_remaining);
+    if (inliers_ratio < params.min_inliers_ratio) break;
+
+    if (!workspace.hypothesis_cache.empty())
+      subtract_from_hypothesis_cache(points, normals, params, detection,
+                                     first_new_object, objects_count,
+                                     workspace);
+
+    if (!active.empty()) {
+      for (uint k = first_new_object; k < objects_count; k++)
+        for (uint i : detection.objects[k].indices) active[i] = 0;
+    }
+
+    std::swap(remaining, workspace.next_remaining);
+    remaining_points.clear();
+    for (uint i : remaining) remaining_points.push_back(points[i]);
+    if (normals != nullptr) {
+      workspace.remaining_normals.clear();
+      for (uint i : remaining)
+        workspace.remaining_normals.push_back((*normals)[i]);
+    }
+  }
+
+  detection.objects.resize(objects_count);
+  detection.remaining.assign(remaining.begin(), remaining.end());
+}
+
+bool set_parameter(RansacParams& params, const std::string& name,
+                   const std::string& value) {
+  // Values of the uint parameters, negative ones would wrap around
+  auto to_uint = [&](uint& parameter) {
+    const int parsed = std::stoi(value);
+    parameter = parsed;
+    return parsed >= 0;
+  };
+
+  try {
+    if (name == "threshold")
+      return (params.threshold = std::stof(value)) > 0;
+    else if (name == "iterations")
+      return to_uint(params.max_number_of_iterations);
+    else if (name == "max_objects")
+      return to_uint(params.max_objects);
+    else if (name == "min_ratio")
+      params.min_inliers_ratio = std::stof(value);
+    else if (name == "shapes")
+      return (params.shapes = parse_shapes(value)) != 0;
+    else if (name == "max_radius")
+      params.max_radius = std::stof(value);
+    else if (name == "scoring")
+      return parse_scoring(value, params.scoring);
+    else if (name == "oriented")
+      params.oriented_normals = std::stoi(value) != 0;
+    else if (name == "connectivity")
+      params.connectivity_radius = std::stof(value);
+    else if (name == "voxel_size")
+      params.voxel_size = std::stof(value);
+    else if (name == "normal_bins")
+      return to_uint(params.normal_bins);
+    else
+      return false;
+  } catch (const std::exception&) {
+    return false;
   }
+  return true;
+}
+
+void SharedIndex::build(const std::vector<Eigen::Vector3f>& points,
+                        const std::vector<Eigen::Vector3f>*,
+                        const RansacParams& params) {
+  if (params.connectivity_radius > 0 || params.pyramid_levels > 1)
+    kdtree.build(points);
+
+  pyramid.levels.clear();
+  pyramid_levels = pyramid_factor = 0;
+  if (params.pyramid_levels > 1) {
+    pyramid.build(kdtree, params.pyramid_levels, params.pyramid_factor);
+    pyramid_levels = params.pyramid_levels;
+    pyramid_factor = params.pyramid_factor;
+  }
+}
+
+Detection ransac_multi(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::optional<std::vector<Eigen::Vector3f>>& normals,
+    const RansacParams& params) {
+  RansacWorkspace workspace(std::rand());
+  Detection detection;
+  ransac_multi(points, normals.has_value() ? &normals.value() : nullptr,
+               params, workspace, detection);
+  return detection;
+}
+
+std::vector<std::vector<Eigen::Vector3f>> ransac_multi(
+    const std::vector<Eigen::Vector3f>& points, const float threshold,
+    const uint max_number_of_iterations, const uint max_objects,
+    const float min_inliers_ratio,
+    const std::optional<std::vector<Eigen::Vector3f>>& normals,
+    bool remove_outliers) {
+  RansacParams params;
+  params.threshold = threshold;
+  params.max_number_of_iterations = max_number_of_iterations;
+  params.max_objects = max_objects;
+  params.min_inliers_ratio = min_inliers_ratio;
+  params.remove_outliers = remove_outliers;
+
+  return split_objects(points, ransac_multi(points, normals, params));
+}
+
+std::vector<std::vector<Eigen::Vector3f>> split_objects(
+    const std::vector<Eigen::Vector3f>& points, const Detection& detection) {
+  std::vector<std::vector<Eigen::Vector3f>> objects;
+  objects.reserve(detection.objects.size() + 1);
+
+  for (const DetectedObject& object : detection.objects) {
+    std::vector<Eigen::Vector3f> object_points;
+    object_points.reserve(object.indices.size());
+    for (uint i : object.indices) object_points.push_back(points[i]);
+    objects.push_back(std::move(object_points));
+  }
+
+  std::vector<Eigen::Vector3f> remaining_points;
+  remaining_points.reserve(detection.remaining.size());
+  for (uint i : detection.remaining) remaining_points.push_back(points[i]);
+  objects.push_back(std::move(remaining_points));
 
-  objects.push_back(remaining_points);
   return objects;
 }
 
-}  // namespace tnp
\ No newline at end of file
+}  // namespace tnp
@@ -3,19 +3,217 @@
 #include <Eigen/Core>
 #include <iostream>
 #include <optional>
+#include <string>
+
+#include "shapes.h"
+#include "workspace.h"
 
 namespace tnp {
-// Ransac for plane detection in 3D
+
+//
+// Score of a hypothesis, computed from the distance d of each point (on the
+// front or back side of the shape, the best side counts):
+//   - INLIER_COUNT: 1 if d <= threshold, the number of inliers
+//   - MSAC: 1 - d^2 / threshold^2 if d <= threshold, the truncated quadratic
+//     cost, close points weigh more than those at the threshold
+//   - MAGSAC: (1 - d / threshold)^2 if d <= threshold, the MSAC score
+//     marginalized over thresholds uniform in (0, threshold], so that the
+//     threshold is only an upper bound of the noise
+// Inliers and outliers of the winner are always split by threshold.
+//
+enum Scoring : uint { INLIER_COUNT = 0, MSAC = 1, MAGSAC = 2 };
+
+// Parse a scoring name ("count", "msac" or "magsac"), false on error
+bool parse_scoring(const std::string& name, Scoring& scoring);
+
+// Best hypothesis found by ransac with its inliers and outliers indices
+template <typename Shape>
+struct ShapeFit {
+  Shape shape;
+  std::vector<uint> inliers;
+  std::vector<uint> outliers;
+};
+
+// Ransac for the detection of one Shape (Plane, Sphere or Cylinder) in 3D
+// Returns std::nullopt if no valid hypothesis could be fitted
+template <typename Shape>
+std::optional<ShapeFit<Shape>> fit_shape(
+    const std::vector<Eigen::Vector3f>& points, const float threshold,
+    const uint max_number_of_iterations,
+    const std::optional<std::vector<Eigen::Vector3f>>& normals = std::nullopt,
+    bool remove_outliers = false);
+
+// Same as above, without allocation once the workspace buffers are large
+// enough: the inliers and outliers are left in workspace.inliers and
+// workspace.outliers. normals may be nullptr.
+// If normal_index is not nullptr (the points and normals binned by normal),
+// plane hypotheses are only scored on the bins where normals may be aligned
+// with theirs. See RansacParams::oriented_normals for oriented_normals.
+// Spheres and cylinders with a radius above max_radius are rejected (0 for
+// no bound).
+template <typename Shape>
+std::optional<Shape> fit_shape(const std::vector<Eigen::Vector3f>& points,
+                               const std::vector<Eigen::Vector3f>* normals,
+                               const float threshold,
+                               const uint max_number_of_iterations,
+                               bool remove_outliers,
+                               RansacWorkspace& workspace,
+                               Scoring scoring = INLIER_COUNT,
+                               const NormalIndex* normal_index = nullptr,
+                               bool oriented_normals = false,
+                               float max_radius = 0);
+
+// Ransac for plane detection in 3D (or any other Shape)
+template <typename Shape = Plane>
 std::pair<std::vector<uint>, std::vector<uint>> ransac(
     const std::vector<Eigen::Vector3f>& points, const float threshold,
     const uint max_number_of_iterations,
     const std::optional<std::vector<Eigen::Vector3f>>& normals = std::nullopt,
     bool remove_outliers = false);
 
+// Parameters of ransac_multi
+struct RansacParams {
+  float threshold = 0.25;
+  uint max_number_of_iterations = 1000;
+  uint max_objects = 5;
+  float min_inliers_ratio = 0.05;
+  bool remove_outliers = false;
+  uint shapes = PLANE;  // ShapeFlags competing at each round
+  // Spheres and cylinders with a larger radius are rejected: far larger than
+  // the point cloud they are as flat as planes and take their points. 0 uses
+  // the diagonal of the bounding box of the points
+  float max_radius = 0;
+  Scoring scoring = INLIER_COUNT;  // score of the hypotheses (see Scoring)
+  // Normals are oriented consistently (e.g. towards the sensor): only the
+  // points whose normal faces the same way as the shape are inliers, instead
+  // of the points on the side of the shape with most of them. The normal of a
+  // plane faces the normals of its samples, spheres and cylinders face
+  // outwards.
+  bool oriented_normals = false;
+
+  // Inliers of an object closer than connectivity_radius are connected, only
+  // the largest connected component is kept (0 disables the splitting)
+  float connectivity_radius = 0;
+  // Keep every component with at least min_inliers_ratio of the points as its
+  // own object instead of only the largest one
+  bool keep_all_components = false;
+
+  // Hypotheses are searched on a voxel_size downsampled copy of the points,
+  // only the winner of each round is classified and refined on all of them
+  // (0 searches on all the points)
+  float voxel_size = 0;
+
+  // Coarse-to-fine search over a pyramid of pyramid_levels levels, each one
+  // pyramid_factor times smaller than the previous one. Hypotheses are scored
+  // on the coarsest level and the pyramid_survivors best ones are rescored on
+  // finer levels (halving at each level) before the full cloud.
+  // Takes precedence over voxel_size (0 or 1 disables the pyramid)
+  uint pyramid_levels = 0;
+  uint pyramid_factor = 4;
+  uint pyramid_survivors = 16;
+
+  // Hypotheses are scored on a 16-bit quantized copy of the remaining points
+  // (and normals) made at each round, the winner of each round is verified
+  // on the points. Only used when neither the pyramid nor the voxel grid is
+  // used
+  bool quantize = false;
+
+  // With normals, the points searched at each round are binned by normal on
+  // a normal_bins x normal_bins grid of the sphere and plane hypotheses only
+  // score the bins that may hold normals aligned with theirs, front or back.
+  // Used by the search on all the points or on the voxel grid (0 disables it)
+  uint normal_bins = 0;
+
+  // Frame sequences: the shapes of the detection given to ransac_multi (the
+  // previous frame) are rescored on the points first, each round keeps the
+  // one with most inliers (refined) as long as one has min_inliers_ratio of
+  // the points, the random search only runs for the rest of the points
+  bool warm_start = false;
+
+  // The hypothesis_cache_size best distinct hypotheses of each random search
+  // (other than the winner) are kept with their inliers among the remaining
+  // points, updated by subtracting the points of each new object. The next
+  // rounds take the best of them without a new search as long as it has
+  // min_inliers_ratio of the points. Hypotheses are distinct if their
+  // directions have a |cosine| below cache_min_alignment or their positions
+  // differ by more than threshold (0 disables the cache)
+  uint hypothesis_cache_size = 0;
+  float cache_min_alignment = 0.99;
+  // Keep a bitset of the inliers of each cached hypothesis so that removing
+  // an object only takes a popcount of the bitsets without the removed
+  // points, instead of classifying its points (uses 2 bits per point and
+  // cached hypothesis, the bitsets of dropped hypotheses are reused by the
+  // next ones so that they are not reallocated at each round)
+  bool cache_bitsets = false;
+};
+
+//
+// Set the parameter of the given name from its text value, false if the name
+// or the value is invalid (counts must not be negative and the threshold must
+// be positive). Names: threshold, iterations, max_objects,
+// min_ratio, shapes (e.g. "plane,sphere"), max_radius, scoring, oriented (0
+// or 1), connectivity, voxel_size and normal_bins.
+//
+bool set_parameter(RansacParams& params, const std::string& name,
+                   const std::string& value);
+
+//
+// Search structures of a point cloud built once and shared (read only) by the
+// workspaces of several ransac_multi calls on the same points, e.g. the
+// configurations of a parameter sweep run in parallel.
+//
+// Example:
+//     SharedIndex index;
+//     index.build(points, normals, params);
+//     RansacWorkspace workspace;
+//     workspace.shared_index = &index;
+//
+struct SharedIndex {
+  KdTree kdtree;
+  Pyramid pyramid;
+  uint pyramid_levels = 0;  // parameters the pyramid was built with
+  uint pyramid_factor = 0;
+
+  // Build the structures needed by ransac_multi with these parameters
+  // (normals may be nullptr)
+  void build(const std::vector<Eigen::Vector3f>& points,
+             const std::vector<Eigen::Vector3f>* normals,
+             const RansacParams& params);
+};
+
+// Shape detected by ransac_multi and the indices of its points
+struct DetectedObject {
+  AnyShape shape;
+  std::vector<uint> indices;
+};
+
+struct Detection {
+  std::vector<DetectedObject> objects;
+  std::vector<uint> remaining;  // indices of the points left unassigned
+};
+
+// Multiple shapes detection, each round keeps the shape with most inliers
+Detection ransac_multi(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::optional<std::vector<Eigen::Vector3f>>& normals,
+    const RansacParams& params);
+
+// Same as above, the scratch buffers of the workspace and the objects of the
+// previous detection are reused (nothing is allocated once they are large
+// enough). normals may be nullptr.
+void ransac_multi(const std::vector<Eigen::Vector3f>& points,
+                  const std::vector<Eigen::Vector3f>* normals,
+                  const RansacParams& params, RansacWorkspace& workspace,
+                  Detection& detection);
+
 std::vector<std::vector<Eigen::Vector3f>> ransac_multi(
     const std::vector<Eigen::Vector3f>& points, const float threshold,
     const uint max_number_of_iterations, const uint max_objects,
     const float min_inliers_ratio,
     const std::optional<std::vector<Eigen::Vector3f>>& normals = std::nullopt,
     bool remove_outliers = false);
-}  // namespace tnp
\ No newline at end of file
+
+// Points of each object followed by the remaining points
+std::vector<std::vector<Eigen::Vector3f>> split_objects(
+    const std::vector<Eigen::Vector3f>& points, const Detection& detection);
+}  // namespace tnp
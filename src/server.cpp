@@ -0,0 +1,317 @@
+#include "server.h"
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "io.h"
+
+namespace tnp {
+
+// Whether the index has the search structures ransac_multi uses with params
+bool index_covers(const SharedIndex& index, const RansacParams& params) {
+  if ((params.connectivity_radius > 0 || params.pyramid_levels > 1) &&
+      index.kdtree.m_root == nullptr)
+    return false;
+  return params.pyramid_levels <= 1 ||
+         (index.pyramid_levels == params.pyramid_levels &&
+          index.pyramid_factor == params.pyramid_factor);
+}
+
+CloudCache::Cloud* CloudCache::get(const std::string& path,
+                                   const RansacParams& params) {
+  struct stat status;
+  if (stat(path.c_str(), &status) != 0) return nullptr;
+  const int64_t mtime =
+      int64_t(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+
+  auto cached = std::find_if(m_clouds.begin(), m_clouds.end(),
+                             [&](const Cloud& c) { return c.path == path; });
+  if (cached != m_clouds.end() && cached->mtime != mtime) {
+    m_clouds.erase(cached);
+    cached = m_clouds.end();
+  }
+
+  if (cached != m_clouds.end()) {
+    m_clouds.splice(m_clouds.begin(), m_clouds, cached);
+  } else {
+    Cloud& cloud = m_clouds.emplace_front();
+    cloud.path = path;
+    cloud.mtime = mtime;
+    if (!load_cloud(path, cloud.points, cloud.normals, cloud.colors)) {
+      m_clouds.pop_front();
+      return nullptr;
+    }
+    for (auto& n : cloud.normals) n.normalize();
+    while (m_clouds.size() > m_capacity) m_clouds.pop_back();
+  }
+
+  Cloud& cloud = m_clouds.front();
+  if (!index_covers(cloud.index, params))
+    cloud.index.build(cloud.points,
+                      cloud.normals.empty() ? nullptr : &cloud.normals,
+                      params);
+  return &cloud;
+}
+
+// Lines read from a file descriptor
+class LineReader {
+ public:
+  explicit LineReader(int fd) : m_fd(fd) {}
+
+  // Next line without its end of line, false at the end of the stream
+  bool read_line(std::string& line) {
+    while (true) {
+      const auto end = m_buffer.find('\n', m_begin);
+      if (end != std::string::npos) {
+        line.assign(m_buffer, m_begin, end - m_begin);
+        m_begin = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+      }
+      m_buffer.erase(0, m_begin);
+      m_begin = 0;
+
+      char chunk[4096];
+      const ssize_t size = ::read(m_fd, chunk, sizeof(chunk));
+      if (size < 0 && errno == EINTR) continue;
+      if (size <= 0) {
+        // Last line without an end of line
+        if (m_buffer.empty()) return false;
+        line.swap(m_buffer);
+        m_buffer.clear();
+        return true;
+      }
+      m_buffer.append(chunk, size);
+    }
+  }
+
+ private:
+  int m_fd;
+  std::string m_buffer;
+  size_t m_begin = 0;  // first byte of m_buffer not read yet
+};
+
+// Write all of data, false if the stream is closed
+bool write_all(const int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    const ssize_t size =
+        ::write(fd, data.data() + written, data.size() - written);
+    if (size < 0 && errno == EINTR) continue;
+    if (size <= 0) return false;
+    written += size;
+  }
+  return true;
+}
+
+bool respond(const int fd, const bool ok, const std::string& text) {
+  return write_all(fd, (ok ? "ok " : "error ") + std::to_string(text.size()) +
+                           "\n" + text);
+}
+
+// Parameters of a shape as written in the responses
+void write_shape(std::ostream& stream, const AnyShape& shape) {
+  stream << shape_name(shape);
+  std::visit(
+      [&](const auto& s) {
+        using Shape = std::decay_t<decltype(s)>;
+        if constexpr (std::is_same_v<Shape, Plane>) {
+          const Eigen::Vector3f normal = s.plane.normal();
+          stream << ' ' << normal.x() << ' ' << normal.y() << ' '
+                 << normal.z() << ' ' << s.plane.offset();
+        } else if constexpr (std::is_same_v<Shape, Sphere>) {
+          stream << ' ' << s.center.x() << ' ' << s.center.y() << ' '
+                 << s.center.z() << ' ' << s.radius;
+        } else {
+          stream << ' ' << s.base.x() << ' ' << s.base.y() << ' '
+                 << s.base.z() << ' ' << s.axis.x() << ' ' << s.axis.y()
+                 << ' ' << s.axis.z() << ' ' << s.radius;
+        }
+      },
+      shape);
+}
+
+// Answer a detect request (the rest of its line), false on error with the
+// error message in response
+bool detect(std::istream& request, CloudCache& cache,
+            const RansacParams& defaults, RansacWorkspace& workspace,
+            Detection& detection, std::ostream& response) {
+  RansacParams params = defaults;
+  std::string path;
+  uint seed = std::mt19937::default_seed;
+  for (std::string pair; request >> pair;) {
+    const auto equal = pair.find('=');
+    if (equal == std::string::npos) {
+      response << "'name=value' expected but '" << pair << "' read instead";
+      return false;
+    }
+    const std::string name = pair.substr(0, equal);
+    const std::string value = pair.substr(equal + 1);
+    bool valid = true;
+    if (name == "path") {
+      path = value;
+    } else if (name == "seed") {
+      try {
+        seed = std::stoul(value);
+      } catch (const std::exception&) {
+        valid = false;
+      }
+    } else {
+      valid = set_parameter(params, name, value);
+    }
+    if (!valid) {
+      response << "invalid '" << pair << "'";
+      return false;
+    }
+  }
+  if (path.empty()) {
+    response << "missing path";
+    return false;
+  }
+
+  CloudCache::Cloud* cloud = cache.get(path, params);
+  if (cloud == nullptr) {
+    response << "failed to load '" << path << "'";
+    return false;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  workspace.rng.seed(seed);
+  workspace.shared_index = &cloud->index;
+  ransac_multi(cloud->points,
+               cloud->normals.empty() ? nullptr : &cloud->normals, params,
+               workspace, detection);
+  workspace.shared_index = nullptr;
+  const std::chrono::duration<double, std::milli> duration =
+      std::chrono::steady_clock::now() - start;
+
+  response << std::setprecision(9) << "objects " << detection.objects.size()
+           << '\n';
+  std::vector<uint> labels(cloud->points.size(), 0);
+  for (uint k = 0; k < detection.objects.size(); k++) {
+    const DetectedObject& object = detection.objects[k];
+    write_shape(response, object.shape);
+    response << ' ' << object.indices.size() << '\n';
+    for (uint i : object.indices) labels[i] = k + 1;
+  }
+  response << "time_ms " << duration.count() << '\n';
+  response << "labels " << labels.size() << '\n';
+  for (uint i = 0; i < labels.size(); i++)
+    response << (i == 0 ? "" : " ") << labels[i];
+  response << '\n';
+  return true;
+}
+
+bool serve(int in_fd, int out_fd, CloudCache& cache,
+           const RansacParams& defaults) {
+  RansacWorkspace workspace;
+  Detection detection;
+  LineReader reader(in_fd);
+  for (std::string line; reader.read_line(line);) {
+    std::istringstream request(line);
+    std::string command;
+    if (!(request >> command)) continue;
+
+    if (command == "quit") {
+      respond(out_fd, true, "");
+      return false;
+    }
+
+    std::ostringstream response;
+    bool ok = false;
+    try {
+      if (command == "detect")
+        ok = detect(request, cache, defaults, workspace, detection, response);
+      else
+        response << "unknown command '" << command << "'";
+    } catch (const std::exception& e) {
+      // A bad request must not stop the server
+      ok = false;
+      response.str("");
+      response << "failed to process the request: " << e.what();
+    }
+
+    // The client is gone
+    if (!respond(out_fd, ok, response.str())) break;
+  }
+  return true;
+}
+
+bool run_server(const std::string& socket_path, const RansacParams& defaults,
+                uint cache_size) {
+  CloudCache cache(cache_size);
+
+  // A client closing its connection must not stop the server
+  std::signal(SIGPIPE, SIG_IGN);
+
+  if (socket_path == "-") {
+    // Responses are the only output on stdout
+    std::streambuf* const cout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+    serve(STDIN_FILENO, STDOUT_FILENO, cache, defaults);
+    std::cout.rdbuf(cout_buffer);
+    return true;
+  }
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path)) {
+    std::cout << "Error: socket path '" << socket_path << "' is too long"
+              << std::endl;
+    return false;
+  }
+  std::strcpy(address.sun_path, socket_path.c_str());
+
+  // Only a stale socket is replaced, never another file
+  struct stat status;
+  if (::lstat(socket_path.c_str(), &status) == 0) {
+    if (!S_ISSOCK(status.st_mode)) {
+      std::cout << "Error: '" << socket_path
+                << "' exists and is not a socket, nothing removed"
+                << std::endl;
+      return false;
+    }
+    ::unlink(socket_path.c_str());
+  }
+
+  const int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server_fd < 0 ||
+      bind(server_fd, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(server_fd, 8) != 0) {
+    std::cout << "Error: failed to listen on socket '" << socket_path << "'"
+              << std::endl;
+    if (server_fd >= 0) ::close(server_fd);
+    return false;
+  }
+  std::cout << "Listening on '" << socket_path << "'" << std::endl;
+
+  bool running = true;
+  while (running) {
+    const int client_fd = accept(server_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      if (errno == EINTR) continue;
+      std::cout << "Error: failed to accept a connection on socket '"
+                << socket_path << "'" << std::endl;
+      break;
+    }
+    running = serve(client_fd, client_fd, cache, defaults);
+    ::close(client_fd);
+  }
+
+  ::close(server_fd);
+  ::unlink(socket_path.c_str());
+  return !running;
+}
+
+}  // namespace tnp
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "ransac.h"
+
+namespace tnp {
+
+//
+// Point clouds kept in memory with their search structures, keyed by file
+// path and modification time: a cloud is reloaded when its file changes and
+// the least recently used ones are evicted beyond capacity clouds.
+//
+class CloudCache {
+ public:
+  struct Cloud {
+    std::string path;
+    int64_t mtime = 0;  // modification time of the file (ns)
+    std::vector<Eigen::Vector3f> points;
+    std::vector<Eigen::Vector3f> normals;  // normalized, empty if none
+    std::vector<Eigen::Vector3f> colors;
+    SharedIndex index;
+  };
+
+  explicit CloudCache(uint capacity) : m_capacity(std::max(1u, capacity)) {}
+
+  // Cloud of the file with the search structures needed by params, nullptr
+  // if it cannot be loaded. The pointer is valid until the next call.
+  Cloud* get(const std::string& path, const RansacParams& params);
+
+ private:
+  uint m_capacity;
+  std::list<Cloud> m_clouds;  // most recently used first
+};
+
+//
+// Detection server answering requests read from in_fd on out_fd until the
+// end of the stream or a "quit" request (then returns false).
+//
+// A request is one line: a command followed by "name=value" pairs.
+//   - detect path=<file> [seed=<n>] [parameters of set_parameter]:
+//     ransac_multi on the cloud (cached by the server), parameters that are
+//     not given keep their value in defaults
+//   - quit: stop the server
+//
+// A response is a header line "ok <size>" or "error <size>" followed by size
+// bytes of text. The text of a detection is:
+//     objects <number of objects>
+//     <one line per object: shape name, parameters, number of points>
+//       plane <normal x y z> <offset>
+//       sphere <center x y z> <radius>
+//       cylinder <point on the axis x y z> <axis x y z> <radius>
+//     time_ms <detection time>
+//     labels <number of points>
+//     <label of each point: 0 if unassigned, k + 1 for the object k>
+//
+bool serve(int in_fd, int out_fd, CloudCache& cache,
+           const RansacParams& defaults);
+
+// Serve the connections of a Unix socket one after the other, or stdin and
+// stdout if socket_path is "-" (logs then go to stderr). A stale socket at
+// socket_path is replaced, any other file is an error. False on error.
+bool run_server(const std::string& socket_path, const RansacParams& defaults,
+                uint cache_size);
+
+}  // namespace tnp
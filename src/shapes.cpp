@@ -0,0 +1,237 @@
+#include "shapes.h"
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/LU>
+#include <sstream>
+#include <type_traits>
+
+namespace tnp {
+
+std::optional<Plane> Plane::fit(
+    const std::array<Eigen::Vector3f, sample_size>& samples,
+    const std::array<Eigen::Vector3f, sample_size>* normals) {
+  Plane plane{Eigen::Hyperplane<float, 3>::Through(samples[0], samples[1],
+                                                    samples[2])};
+
+  // Face the normals of the samples, as oriented normals are matched on the
+  // front side only
+  if (normals != nullptr) {
+    const Eigen::Vector3f sum = (*normals)[0] + (*normals)[1] + (*normals)[2];
+    if (sum.dot(plane.plane.normal()) < 0) plane.plane.coeffs() *= -1;
+  }
+  return plane;
+}
+
+void Plane::refine(const std::vector<Eigen::Vector3f>& points,
+                   const std::vector<uint>& indices) {
+  if (indices.size() < sample_size) return;
+
+  Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+  for (uint i : indices) centroid += points[i];
+  centroid /= indices.size();
+
+  Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+  for (uint i : indices) {
+    const Eigen::Vector3f d = points[i] - centroid;
+    covariance += d * d.transpose();
+  }
+
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+  Eigen::Vector3f normal = solver.eigenvectors().col(0);
+
+  // Keep the orientation of the hypothesis so that front/back faces match
+  if (normal.dot(plane.normal()) < 0) normal = -normal;
+  plane = Eigen::Hyperplane<float, 3>(normal, centroid);
+}
+
+std::optional<Sphere> Sphere::fit(
+    const std::array<Eigen::Vector3f, sample_size>& samples,
+    const std::array<Eigen::Vector3f, sample_size>* normals) {
+  // The center c is equidistant to the 4 samples:
+  //   2 (p_i - p_0) . c = |p_i|^2 - |p_0|^2
+  Eigen::Matrix3f A;
+  Eigen::Vector3f b;
+  for (uint i = 1; i < sample_size; i++) {
+    A.row(i - 1) = 2 * (samples[i] - samples[0]).transpose();
+    b[i - 1] = samples[i].squaredNorm() - samples[0].squaredNorm();
+  }
+
+  Eigen::FullPivLU<Eigen::Matrix3f> lu(A);
+  if (!lu.isInvertible()) return std::nullopt;
+
+  Sphere sphere;
+  sphere.center = lu.solve(b);
+  sphere.radius = (samples[0] - sphere.center).norm();
+  if (!std::isfinite(sphere.radius)) return std::nullopt;
+
+  // Reject hypotheses whose surface normals disagree with the samples ones
+  if (normals != nullptr) {
+    for (uint i = 0; i < sample_size; i++) {
+      if (std::abs(sphere.normal_at(samples[i]).dot((*normals)[i])) <
+          NORMAL_ALIGNMENT_THRESHOLD)
+        return std::nullopt;
+    }
+  }
+  return sphere;
+}
+
+void Sphere::refine(const std::vector<Eigen::Vector3f>& points,
+                    const std::vector<uint>& indices) {
+  if (indices.size() < sample_size) return;
+
+  // |p|^2 = 2 p . c + (r^2 - |c|^2) is linear in (c, r^2 - |c|^2)
+  Eigen::Matrix4f AtA = Eigen::Matrix4f::Zero();
+  Eigen::Vector4f Atb = Eigen::Vector4f::Zero();
+  for (uint i : indices) {
+    const Eigen::Vector4f row(2 * points[i].x(), 2 * points[i].y(),
+                              2 * points[i].z(), 1);
+    AtA += row * row.transpose();
+    Atb += row * points[i].squaredNorm();
+  }
+
+  Eigen::FullPivLU<Eigen::Matrix4f> lu(AtA);
+  if (!lu.isInvertible()) return;
+  const Eigen::Vector4f x = lu.solve(Atb);
+
+  const Eigen::Vector3f center = x.head<3>();
+  const float squared_radius = x[3] + center.squaredNorm();
+  if (squared_radius <= 0) return;
+
+  this->center = center;
+  this->radius = std::sqrt(squared_radius);
+}
+
+std::optional<Cylinder> Cylinder::fit(
+    const std::array<Eigen::Vector3f, sample_size>& samples,
+    const std::array<Eigen::Vector3f, sample_size>* normals) {
+  if (normals == nullptr) return std::nullopt;
+
+  const Eigen::Vector3f& n0 = (*normals)[0];
+  const Eigen::Vector3f& n1 = (*normals)[1];
+
+  // Both normals are orthogonal to the axis
+  Eigen::Vector3f axis = n0.cross(n1);
+  if (axis.norm() < 1e-3) return std::nullopt;
+  axis.normalize();
+
+  // Intersect the 2 normal lines projected on the plane orthogonal to the
+  // axis: q0 + t n0 = q1 + s n1 (least squares since they live in 3D)
+  const Eigen::Vector3f q0 = samples[0] - samples[0].dot(axis) * axis;
+  const Eigen::Vector3f q1 = samples[1] - samples[1].dot(axis) * axis;
+
+  Eigen::Matrix<float, 3, 2> A;
+  A.col(0) = n0;
+  A.col(1) = -n1;
+  const Eigen::Vector2f ts = (A.transpose() * A).ldlt().solve(
+      A.transpose() * (q1 - q0));
+
+  Cylinder cylinder;
+  cylinder.axis = axis;
+  cylinder.base = 0.5 * (q0 + ts[0] * n0 + q1 + ts[1] * n1);
+  cylinder.radius =
+      0.5 * ((q0 - cylinder.base).norm() + (q1 - cylinder.base).norm());
+  if (!std::isfinite(cylinder.radius)) return std::nullopt;
+
+  return cylinder;
+}
+
+void Cylinder::refine(const std::vector<Eigen::Vector3f>& points,
+                      const std::vector<uint>& indices) {
+  if (indices.size() < 3) return;
+
+  // Coordinates in a basis (u, v) of the plane orthogonal to the axis,
+  // relative to their mean for the precision
+  const Eigen::Vector3f u = axis.unitOrthogonal();
+  const Eigen::Vector3f v = axis.cross(u);
+  Eigen::Vector2f mean = Eigen::Vector2f::Zero();
+  for (uint i : indices)
+    mean += Eigen::Vector2f(points[i].dot(u), points[i].dot(v));
+  mean /= indices.size();
+
+  // |q|^2 = 2 q . c + (r^2 - |c|^2) is linear in (c, r^2 - |c|^2)
+  Eigen::Matrix3f AtA = Eigen::Matrix3f::Zero();
+  Eigen::Vector3f Atb = Eigen::Vector3f::Zero();
+  for (uint i : indices) {
+    const Eigen::Vector2f q =
+        Eigen::Vector2f(points[i].dot(u), points[i].dot(v)) - mean;
+    const Eigen::Vector3f row(2 * q.x(), 2 * q.y(), 1);
+    AtA += row * row.transpose();
+    Atb += row * q.squaredNorm();
+  }
+
+  Eigen::FullPivLU<Eigen::Matrix3f> lu(AtA);
+  if (!lu.isInvertible()) return;
+  const Eigen::Vector3f x = lu.solve(Atb);
+
+  const Eigen::Vector2f center = x.head<2>();
+  const float squared_radius = x[2] + center.squaredNorm();
+  if (squared_radius <= 0) return;
+
+  const Eigen::Vector2f c = center + mean;
+  base = c.x() * u + c.y() * v;
+  radius = std::sqrt(squared_radius);
+}
+
+bool Plane::similar(const Plane& other, float min_alignment,
+                    float tolerance) const {
+  // The planes may have opposite orientations
+  const float alignment = plane.normal().dot(other.plane.normal());
+  const float offset = alignment >= 0 ? plane.offset() - other.plane.offset()
+                                      : plane.offset() + other.plane.offset();
+  return std::abs(alignment) >= min_alignment && std::abs(offset) <= tolerance;
+}
+
+bool Sphere::similar(const Sphere& other, float, float tolerance) const {
+  return (center - other.center).norm() <= tolerance &&
+         std::abs(radius - other.radius) <= tolerance;
+}
+
+bool Cylinder::similar(const Cylinder& other, float min_alignment,
+                       float tolerance) const {
+  const Eigen::Vector3f v = other.base - base;
+  return std::abs(axis.dot(other.axis)) >= min_alignment &&
+         (v - v.dot(axis) * axis).norm() <= tolerance &&
+         std::abs(radius - other.radius) <= tolerance;
+}
+
+bool similar(const AnyShape& a, const AnyShape& b, float min_alignment,
+             float tolerance) {
+  return std::visit(
+      [&](const auto& shape_a, const auto& shape_b) {
+        if constexpr (std::is_same_v<decltype(shape_a), decltype(shape_b)>)
+          return shape_a.similar(shape_b, min_alignment, tolerance);
+        else
+          return false;
+      },
+      a, b);
+}
+
+const char* shape_name(const AnyShape& shape) {
+  switch (shape.index()) {
+    case 0:
+      return "plane";
+    case 1:
+      return "sphere";
+    default:
+      return "cylinder";
+  }
+}
+
+uint parse_shapes(const std::string& list) {
+  uint shapes = 0;
+  std::istringstream ss(list);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    if (name == "plane")
+      shapes |= PLANE;
+    else if (name == "sphere")
+      shapes |= SPHERE;
+    else if (name == "cylinder")
+      shapes |= CYLINDER;
+    else
+      return 0;
+  }
+  return shapes;
+}
+
+}  // namespace tnp
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <array>
+#include <optional>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace tnp {
+
+// Minimum |cosine| between a point normal and the shape normal at that point
+inline constexpr float NORMAL_ALIGNMENT_THRESHOLD = 0.75f;
+
+// Flags used to select which shapes ransac_multi is allowed to detect
+enum ShapeFlags : uint { PLANE = 1 << 0, SPHERE = 1 << 1, CYLINDER = 1 << 2 };
+
+//
+// Shape models used by ransac as a compile-time template parameter.
+// Every model provides:
+//   - sample_size: number of points needed to fit a hypothesis
+//   - fit(samples, normals): hypothesis from the samples (normals may be
+//     nullptr), std::nullopt if the samples are degenerate
+//   - distance(p): absolute distance from p to the surface
+//   - normal_at(p): unit normal of the surface at the projection of p
+//   - refine(points, indices): least squares fit on the inliers (optional)
+//   - similar(other, min_alignment, tolerance): whether other is the same
+//     shape up to the tolerances (directions with a |cosine| of at least
+//     min_alignment, positions and radii closer than tolerance)
+//
+// distance and normal_at are inline so that the scoring loop of ransac can
+// be vectorized by the compiler.
+//
+
+// Infinite plane through 3 points
+struct Plane {
+  static constexpr uint sample_size = 3;
+  static constexpr uint flag = PLANE;
+  static constexpr bool needs_normals = false;
+
+  Eigen::Hyperplane<float, 3> plane;
+
+  static std::optional<Plane> fit(
+      const std::array<Eigen::Vector3f, sample_size>& samples,
+      const std::array<Eigen::Vector3f, sample_size>* normals);
+
+  float distance(const Eigen::Vector3f& p) const {
+    return plane.absDistance(p);
+  }
+  Eigen::Vector3f normal_at(const Eigen::Vector3f&) const {
+    return plane.normal();
+  }
+
+  // Total least squares plane of the inliers (normal = smallest eigenvector)
+  void refine(const std::vector<Eigen::Vector3f>& points,
+              const std::vector<uint>& indices);
+
+  bool similar(const Plane& other, float min_alignment, float tolerance) const;
+};
+
+// Sphere through 4 points
+struct Sphere {
+  static constexpr uint sample_size = 4;
+  static constexpr uint flag = SPHERE;
+  static constexpr bool needs_normals = false;
+
+  Eigen::Vector3f center;
+  float radius;
+
+  static std::optional<Sphere> fit(
+      const std::array<Eigen::Vector3f, sample_size>& samples,
+      const std::array<Eigen::Vector3f, sample_size>* normals);
+
+  float distance(const Eigen::Vector3f& p) const {
+    return std::abs((p - center).norm() - radius);
+  }
+  Eigen::Vector3f normal_at(const Eigen::Vector3f& p) const {
+    return (p - center).normalized();
+  }
+
+  // Algebraic least squares sphere of the inliers
+  void refine(const std::vector<Eigen::Vector3f>& points,
+              const std::vector<uint>& indices);
+
+  bool similar(const Sphere& other, float min_alignment,
+               float tolerance) const;
+};
+
+// Infinite cylinder through 2 oriented points (normals are required)
+struct Cylinder {
+  static constexpr uint sample_size = 2;
+  static constexpr uint flag = CYLINDER;
+  static constexpr bool needs_normals = true;
+
+  Eigen::Vector3f axis;  // unit direction of the axis
+  Eigen::Vector3f base;  // point on the axis
+  float radius;
+
+  static std::optional<Cylinder> fit(
+      const std::array<Eigen::Vector3f, sample_size>& samples,
+      const std::array<Eigen::Vector3f, sample_size>* normals);
+
+  float distance(const Eigen::Vector3f& p) const {
+    const Eigen::Vector3f v = p - base;
+    return std::abs((v - v.dot(axis) * axis).norm() - radius);
+  }
+  Eigen::Vector3f normal_at(const Eigen::Vector3f& p) const {
+    const Eigen::Vector3f v = p - base;
+    return (v - v.dot(axis) * axis).normalized();
+  }
+
+  // Algebraic least squares circle of the inliers projected on the plane
+  // orthogonal to the axis (the axis is kept)
+  void refine(const std::vector<Eigen::Vector3f>& points,
+              const std::vector<uint>& indices);
+
+  bool similar(const Cylinder& other, float min_alignment,
+               float tolerance) const;
+};
+
+using AnyShape = std::variant<Plane, Sphere, Cylinder>;
+
+// Same type of shape and similar parameters (see the similar method)
+bool similar(const AnyShape& a, const AnyShape& b, float min_alignment,
+             float tolerance);
+
+// Human readable name of a shape ("plane", "sphere" or "cylinder")
+const char* shape_name(const AnyShape& shape);
+
+// Parse a comma separated list of shape names into ShapeFlags, 0 on error
+uint parse_shapes(const std::string& list);
+
+}  // namespace tnp
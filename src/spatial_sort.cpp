@@ -0,0 +1,134 @@
+#include "spatial_sort.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <array>
+
+#include "thread_pool.h"
+
+namespace tnp {
+
+// Number of bits of each coordinate in a Morton code (3 * 21 = 63 bits)
+constexpr uint MORTON_BITS = 21;
+
+// Radix sort digits
+constexpr uint RADIX_BITS = 8;
+constexpr uint RADIX_SIZE = 1 << RADIX_BITS;
+
+// Spread the 21 low bits of x so that there are 2 zero bits between them
+uint64_t spread_bits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffff;
+  x = (x | x << 16) & 0x1f0000ff0000ff;
+  x = (x | x << 8) & 0x100f00f00f00f00f;
+  x = (x | x << 4) & 0x10c30c30c30c30c3;
+  x = (x | x << 2) & 0x1249249249249249;
+  return x;
+}
+
+void morton_codes(const std::vector<Eigen::Vector3f>& points,
+                  std::vector<uint64_t>& codes) {
+  codes.resize(points.size());
+  if (points.empty()) return;
+
+  Eigen::AlignedBox<float, 3> box;
+  for (const Eigen::Vector3f& p : points) box.extend(p);
+
+  const float max_cell = (1 << MORTON_BITS) - 1;
+  const Eigen::Vector3f scale =
+      max_cell * box.diagonal().cwiseMax(1e-30f).cwiseInverse();
+
+  default_thread_pool().parallel_for(
+      points.size(), 4096, [&](uint begin, uint end) {
+        for (uint i = begin; i < end; i++) {
+          const Eigen::Vector3f cell =
+              ((points[i] - box.min()).cwiseProduct(scale))
+                  .cwiseMax(0.f)
+                  .cwiseMin(max_cell);
+          codes[i] = spread_bits(uint64_t(cell.x())) |
+                     spread_bits(uint64_t(cell.y())) << 1 |
+                     spread_bits(uint64_t(cell.z())) << 2;
+        }
+      });
+}
+
+std::vector<uint> morton_order(const std::vector<Eigen::Vector3f>& points) {
+  const uint size = points.size();
+  std::vector<uint64_t> codes;
+  morton_codes(points, codes);
+
+  std::vector<uint> order(size);
+  for (uint i = 0; i < size; i++) order[i] = i;
+  if (size < 2) return order;
+
+  // Codes of order are kept next to it so that passes read them linearly
+  std::vector<uint64_t>& sorted_codes = codes;
+  std::vector<uint64_t> next_codes(size);
+  std::vector<uint> next_order(size);
+
+  ThreadPool& pool = default_thread_pool();
+  const uint chunks = std::min<uint>(pool.size(), (size + 4095) / 4096);
+  std::vector<std::array<uint, RADIX_SIZE>> histograms(chunks);
+
+  for (uint shift = 0; shift < 3 * MORTON_BITS; shift += RADIX_BITS) {
+    // Histogram of the digits of each chunk
+    pool.parallel_chunks(size, chunks, [&](uint c, uint begin, uint end) {
+      histograms[c].fill(0);
+      for (uint i = begin; i < end; i++)
+        histograms[c][(sorted_codes[i] >> shift) & (RADIX_SIZE - 1)]++;
+    });
+
+    // The pass is useless if every code has the same digit
+    std::array<uint, RADIX_SIZE> totals{};
+    for (uint c = 0; c < chunks; c++)
+      for (uint d = 0; d < RADIX_SIZE; d++) totals[d] += histograms[c][d];
+    if (std::count(totals.begin(), totals.end(), size) == 1) continue;
+
+    // First position of each digit in each chunk: digits in increasing order,
+    // chunks in increasing order within a digit (the sort is stable)
+    uint position = 0;
+    for (uint d = 0; d < RADIX_SIZE; d++) {
+      for (uint c = 0; c < chunks; c++) {
+        const uint count = histograms[c][d];
+        histograms[c][d] = position;
+        position += count;
+      }
+    }
+
+    pool.parallel_chunks(size, chunks, [&](uint c, uint begin, uint end) {
+      std::array<uint, RADIX_SIZE>& positions = histograms[c];
+      for (uint i = begin; i < end; i++) {
+        const uint digit = (sorted_codes[i] >> shift) & (RADIX_SIZE - 1);
+        next_codes[positions[digit]] = sorted_codes[i];
+        next_order[positions[digit]++] = order[i];
+      }
+    });
+    std::swap(sorted_codes, next_codes);
+    std::swap(order, next_order);
+  }
+  return order;
+}
+
+void permute(const std::vector<uint>& order,
+             std::vector<Eigen::Vector3f>& values) {
+  if (values.empty()) return;
+
+  std::vector<Eigen::Vector3f> permuted(order.size());
+  default_thread_pool().parallel_for(
+      order.size(), 4096, [&](uint begin, uint end) {
+        for (uint i = begin; i < end; i++) permuted[i] = values[order[i]];
+      });
+  values.swap(permuted);
+}
+
+std::vector<uint> morton_sort(std::vector<Eigen::Vector3f>& points,
+                              std::vector<Eigen::Vector3f>& normals,
+                              std::vector<Eigen::Vector3f>& colors) {
+  std::vector<uint> order = morton_order(points);
+  permute(order, points);
+  permute(order, normals);
+  permute(order, colors);
+  return order;
+}
+
+}  // namespace tnp
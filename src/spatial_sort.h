@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <cstdint>
+#include <vector>
+
+namespace tnp {
+
+// Morton code of each point: its cell in a 2^21 grid over the bounding box of
+// the points, with the bits of the 3 coordinates interleaved (63 bits)
+void morton_codes(const std::vector<Eigen::Vector3f>& points,
+                  std::vector<uint64_t>& codes);
+
+// Permutation sorting the points along the Morton curve: the sorted cloud
+// holds points[order[i]] at i. Codes are sorted with a parallel LSD radix
+// sort (8 bits per pass, passes where all the codes share a digit are
+// skipped), points with the same code keep their order.
+std::vector<uint> morton_order(const std::vector<Eigen::Vector3f>& points);
+
+// Apply the permutation to the values (values[order[i]] moves to i), empty
+// values are left unchanged
+void permute(const std::vector<uint>& order,
+             std::vector<Eigen::Vector3f>& values);
+
+//
+// Reorder the points, normals and colors (if not empty) along the Morton curve
+// so that spatial neighbors are close in memory. Returns the permutation:
+// index i of the sorted cloud is index order[i] of the input, e.g. to map
+// the indices of detected objects back to the input.
+//
+// Example:
+//     std::vector<uint> order = morton_sort(points, normals, colors);
+//     Detection detection = ransac_multi(points, normals, params);
+//     for (uint& i : detection.objects[0].indices) i = order[i];
+//
+std::vector<uint> morton_sort(std::vector<Eigen::Vector3f>& points,
+                              std::vector<Eigen::Vector3f>& normals,
+                              std::vector<Eigen::Vector3f>& colors);
+
+}  // namespace tnp
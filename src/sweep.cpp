@@ -0,0 +1,164 @@
+#include "sweep.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "thread_pool.h"
+
+namespace tnp {
+
+bool load_sweep(const std::string& filename, const RansacParams& base,
+                std::vector<RansacParams>& configurations) {
+  configurations.clear();
+
+  std::ifstream fs(filename);
+  if (!fs.is_open()) {
+    std::cout << "Error: failed to open sweep file '" << filename << "'"
+              << std::endl;
+    return false;
+  }
+
+  std::string line;
+  for (auto idx_line = 0; std::getline(fs, line); ++idx_line) {
+    if (line.empty() || line.front() == '#') continue;
+
+    // Every combination of the values of the line
+    std::vector<RansacParams> combinations{base};
+    std::istringstream ss(line);
+    std::string pair;
+    while (ss >> pair) {
+      const auto equal = pair.find('=');
+      const std::string name = pair.substr(0, equal);
+      std::vector<std::string> values;
+      if (equal != std::string::npos) {
+        std::istringstream values_ss(pair.substr(equal + 1));
+        for (std::string value; std::getline(values_ss, value, ',');)
+          values.push_back(value);
+      }
+      if (values.empty()) {
+        std::cout << "Error: failed to read line " << idx_line
+                  << " of sweep file '" << filename << "', 'name=value' "
+                  << "expected but '" << pair << "' read instead"
+                  << std::endl;
+        return false;
+      }
+
+      std::vector<RansacParams> expanded;
+      for (const RansacParams& params : combinations) {
+        for (const std::string& value : values) {
+          expanded.push_back(params);
+          if (!set_parameter(expanded.back(), name, value)) {
+            std::cout << "Error: failed to read line " << idx_line
+                      << " of sweep file '" << filename << "', invalid '"
+                      << pair << "'" << std::endl;
+            return false;
+          }
+        }
+      }
+      combinations = std::move(expanded);
+    }
+    configurations.insert(configurations.end(), combinations.begin(),
+                          combinations.end());
+  }
+
+  if (configurations.empty()) {
+    std::cout << "Error: no configuration read from sweep file '" << filename
+              << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::vector<SweepResult> sweep(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>* normals,
+    const std::vector<RansacParams>& configurations) {
+  std::vector<SweepResult> results(configurations.size());
+  if (configurations.empty()) return results;
+
+  // The kd-tree is built if any configuration needs it, the pyramid is not
+  // swept
+  RansacParams index_params = configurations.front();
+  for (const RansacParams& params : configurations)
+    index_params.connectivity_radius =
+        std::max(index_params.connectivity_radius, params.connectivity_radius);
+  SharedIndex index;
+  index.build(points, normals, index_params);
+
+  default_thread_pool().parallel_for(
+      configurations.size(), 1, [&](uint begin, uint end) {
+        RansacWorkspace workspace;
+        workspace.shared_index = &index;
+        Detection detection;
+
+        for (uint c = begin; c < end; c++) {
+          // Configurations are independent: with warm_start, the objects of
+          // the previous configuration of the chunk must not seed this one
+          detection.objects.clear();
+          workspace.rng.seed(c + 1);
+          const auto start = std::chrono::steady_clock::now();
+          ransac_multi(points, normals, configurations[c], workspace,
+                       detection);
+          const std::chrono::duration<double, std::milli> duration =
+              std::chrono::steady_clock::now() - start;
+
+          SweepResult& result = results[c];
+          result.params = configurations[c];
+          result.milliseconds = duration.count();
+          result.objects = detection.objects.size();
+          result.smallest_object = detection.objects.empty() ? 0 : ~0u;
+          for (const DetectedObject& object : detection.objects) {
+            const uint size = object.indices.size();
+            result.inliers += size;
+            result.smallest_object = std::min(result.smallest_object, size);
+            result.largest_object = std::max(result.largest_object, size);
+          }
+        }
+      });
+  return results;
+}
+
+// Names of the Scoring values as parsed by parse_scoring
+const char* const SCORING_NAMES[] = {"count", "msac", "magsac"};
+
+// Comma separated names of the ShapeFlags as parsed by parse_shapes
+std::string shapes_names(const uint shapes) {
+  std::string names;
+  for (const auto& [flag, name] : {std::pair{PLANE, "plane"},
+                                   std::pair{SPHERE, "sphere"},
+                                   std::pair{CYLINDER, "cylinder"}})
+    if (shapes & flag) names += (names.empty() ? "" : ",") + std::string(name);
+  return names;
+}
+
+void write_sweep_table(std::ostream& stream,
+                       const std::vector<SweepResult>& results,
+                       const uint number_of_points) {
+  stream << "configuration\tthreshold\titerations\tmax_objects\tmin_ratio\t"
+            "shapes\tmax_radius\tscoring\toriented\tconnectivity\tvoxel_size\t"
+            "normal_bins\t"
+            "time_ms\tobjects\tinliers\tinliers_ratio\tsmallest_object\t"
+            "largest_object\n";
+  for (uint c = 0; c < results.size(); c++) {
+    const SweepResult& result = results[c];
+    const RansacParams& params = result.params;
+    stream << c << '\t' << params.threshold << '\t'
+           << params.max_number_of_iterations << '\t' << params.max_objects
+           << '\t' << params.min_inliers_ratio << '\t'
+           << shapes_names(params.shapes) << '\t' << params.max_radius << '\t'
+           << SCORING_NAMES[params.scoring] << '\t'
+           << params.oriented_normals << '\t'
+           << params.connectivity_radius << '\t' << params.voxel_size << '\t'
+           << params.normal_bins << '\t'
+           << result.milliseconds << '\t' << result.objects << '\t'
+           << result.inliers << '\t'
+           << float(result.inliers) / std::max(1u, number_of_points) << '\t'
+           << result.smallest_object << '\t' << result.largest_object
+           << '\n';
+  }
+}
+
+}  // namespace tnp
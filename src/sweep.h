@@ -0,0 +1,55 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ransac.h"
+
+namespace tnp {
+
+//
+// Configurations of a parameter sweep, one per line of the file as
+// "name=value" pairs separated by spaces. A comma separated list of values
+// sweeps all of them, a line stands for every combination of its values.
+// Parameters that are not given keep their value in base.
+//
+// Names are those of set_parameter (a list of shapes is split into one
+// configuration per shape). Empty lines and lines starting with '#' are
+// ignored.
+//
+// Example:
+//     # 6 configurations
+//     threshold=0.1,0.25,0.5 min_ratio=0.02,0.05
+//
+bool load_sweep(const std::string& filename, const RansacParams& base,
+                std::vector<RansacParams>& configurations);
+
+// Runtime and detected objects of a configuration
+struct SweepResult {
+  RansacParams params;
+  double milliseconds = 0;
+  uint objects = 0;
+  uint inliers = 0;  // points of all the objects
+  uint smallest_object = 0;
+  uint largest_object = 0;
+};
+
+//
+// Run ransac_multi with each configuration on the same points (normals may
+// be nullptr). The search structures are built once and the configurations
+// run in parallel on the default thread pool (each one on a single thread),
+// configuration i uses the seed i + 1 so that results are reproducible.
+//
+std::vector<SweepResult> sweep(
+    const std::vector<Eigen::Vector3f>& points,
+    const std::vector<Eigen::Vector3f>* normals,
+    const std::vector<RansacParams>& configurations);
+
+// Tab separated table of the results with a header line
+void write_sweep_table(std::ostream& stream,
+                       const std::vector<SweepResult>& results,
+                       const uint number_of_points);
+
+}  // namespace tnp
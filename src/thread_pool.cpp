@@ -0,0 +1,222 @@
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+namespace tnp {
+
+// Set by the threads running a loop, nested loops run serially
+thread_local bool inside_loop = false;
+
+// Sets inside_loop for its lifetime, even if the loop throws
+struct InsideLoop {
+  InsideLoop() : previous(inside_loop) { inside_loop = true; }
+  ~InsideLoop() { inside_loop = previous; }
+  const bool previous;
+};
+
+// Spins of an idle worker before it sleeps, short loops started one after
+// the other (e.g. on small frames) do not pay for the wake up
+constexpr uint IDLE_SPINS = 1 << 14;
+
+// CPUs the process may run on, in increasing order
+std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0)
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+  return cpus;
+}
+
+// Numbers of a sysfs list such as "0-3,8-11", empty if the file is missing
+std::vector<int> read_sysfs_list(const std::string& path) {
+  std::vector<int> numbers;
+  std::ifstream file(path);
+  std::string range;
+  while (std::getline(file, range, ',')) {
+    std::istringstream stream(range);
+    int first = 0;
+    if (!(stream >> first)) continue;
+    int last = first;
+    char dash = 0;
+    if (stream >> dash && dash == '-') stream >> last;
+    for (int number = first; number <= last; number++)
+      numbers.push_back(number);
+  }
+  return numbers;
+}
+
+// Allowed CPUs grouped by NUMA node, in increasing order within a node (the
+// CPUs of a node are often interleaved with the other nodes' ones)
+std::vector<int> cpus_by_node() {
+  std::vector<int> cpus;
+  std::vector<bool> left(CPU_SETSIZE, false);
+  for (int cpu : allowed_cpus()) left[cpu] = true;
+
+  const std::string nodes = "/sys/devices/system/node/";
+  for (int node : read_sysfs_list(nodes + "online"))
+    for (int cpu : read_sysfs_list(nodes + "node" + std::to_string(node) +
+                                   "/cpulist"))
+      if (cpu >= 0 && cpu < CPU_SETSIZE && left[cpu]) {
+        cpus.push_back(cpu);
+        left[cpu] = false;
+      }
+
+  // CPUs of no known node, e.g. without sysfs
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    if (left[cpu]) cpus.push_back(cpu);
+  return cpus;
+}
+
+ThreadPool::ThreadPool(uint threads, bool pin_threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  m_queues = std::vector<Queue>(threads);
+  // Consecutive workers, which get consecutive blocks of chunks, are spread
+  // evenly over the CPUs grouped by node
+  const std::vector<int> cpus =
+      pin_threads ? cpus_by_node() : std::vector<int>();
+  for (uint worker = 1; worker < threads; worker++) {
+    m_workers.emplace_back(&ThreadPool::worker_loop, this, worker);
+    if (!cpus.empty()) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[uint64_t(worker) * cpus.size() / threads], &set);
+      pthread_setaffinity_np(m_workers.back().native_handle(), sizeof(set),
+                             &set);
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_all();
+  for (std::thread& worker : m_workers) worker.join();
+}
+
+void ThreadPool::run(const uint chunks, void (*call)(const void*, uint),
+                     const void* context) {
+  std::unique_lock<std::mutex> busy(m_busy, std::defer_lock);
+  if (m_workers.empty() || chunks == 1 || inside_loop || !busy.try_lock()) {
+    for (uint chunk = 0; chunk < chunks; chunk++) call(context, chunk);
+    return;
+  }
+
+  m_call = call;
+  m_context = context;
+  m_pending = chunks;
+  m_failed = false;
+  m_error = nullptr;
+  const uint workers = m_queues.size();
+  for (uint worker = 0; worker < workers; worker++) {
+    std::lock_guard<std::mutex> lock(m_queues[worker].mutex);
+    m_queues[worker].front = uint64_t(chunks) * worker / workers;
+    m_queues[worker].back = uint64_t(chunks) * (worker + 1) / workers;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+  }
+  m_wake.notify_all();
+
+  {
+    InsideLoop inside;
+    work(0);
+    while (m_pending > 0) std::this_thread::yield();
+  }
+
+  // No worker touches the task or the error anymore
+  if (m_failed) {
+    std::exception_ptr error = nullptr;
+    std::swap(error, m_error);
+    std::rethrow_exception(error);
+  }
+}
+
+// Next chunk of the worker: the front of its own queue, or else the back of
+// the queue of the nearest worker with chunks left
+bool ThreadPool::pop(const uint worker, uint& chunk) {
+  {
+    Queue& queue = m_queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.front < queue.back) {
+      chunk = queue.front++;
+      return true;
+    }
+  }
+  const uint workers = m_queues.size();
+  for (uint offset = 1; offset < workers; offset++) {
+    Queue& queue = m_queues[(worker + offset) % workers];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.front < queue.back) {
+      chunk = --queue.back;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::work(const uint worker) {
+  uint chunk;
+  while (pop(worker, chunk)) {
+    // After an exception the chunks left are only drained
+    if (!m_failed) {
+      try {
+        m_call(m_context, chunk);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        if (!m_failed) m_error = std::current_exception();
+        m_failed = true;
+      }
+    }
+    m_pending--;
+  }
+}
+
+void ThreadPool::worker_loop(const uint worker) {
+  inside_loop = true;
+  uint generation = 0;
+  while (true) {
+    for (uint spin = 0; spin < IDLE_SPINS && m_generation == generation;
+         spin++)
+      std::this_thread::yield();
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_wake.wait(lock,
+                  [&] { return m_stop || m_generation != generation; });
+      if (m_stop) return;
+      generation = m_generation;
+    }
+    work(worker);
+  }
+}
+
+std::mutex default_thread_pool_mutex;
+std::unique_ptr<ThreadPool> default_thread_pool_instance;
+
+ThreadPool& default_thread_pool() {
+  std::lock_guard<std::mutex> lock(default_thread_pool_mutex);
+  if (default_thread_pool_instance == nullptr)
+    default_thread_pool_instance = std::make_unique<ThreadPool>();
+  return *default_thread_pool_instance;
+}
+
+void set_default_thread_pool(uint threads, bool pin_threads) {
+  std::lock_guard<std::mutex> lock(default_thread_pool_mutex);
+  default_thread_pool_instance =
+      std::make_unique<ThreadPool>(threads, pin_threads);
+}
+
+}  // namespace tnp
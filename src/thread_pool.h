@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tnp {
+
+//
+// Persistent pool of worker threads running parallel loops.
+//
+// A loop is cut into chunks, each worker gets a contiguous block of them in
+// its own queue and steals from the other queues (starting with its
+// neighbours) once its block is done. The calling thread works as worker 0.
+// Blocks are assigned the same way at each call so that a worker keeps
+// touching the same part of the data, and with pinning, neighbour workers
+// run on CPUs of the same NUMA node.
+//
+// Loops started from inside a loop, or while another thread uses the pool,
+// run serially on the calling thread instead of oversubscribing the CPUs.
+//
+// If a chunk throws, the chunks left are skipped and the first exception is
+// rethrown by the loop on the calling thread once no worker runs it anymore.
+//
+// Example:
+//     ThreadPool& pool = default_thread_pool();
+//     pool.parallel_for(points.size(), 4096, [&](uint begin, uint end) {
+//       for (uint i = begin; i < end; i++) points[i] *= 2;
+//     });
+//
+class ThreadPool {
+ public:
+  // threads = 0 uses one thread per core, pinned workers are bound to one
+  // CPU each, contiguous ranges of workers sharing a NUMA node (read from
+  // /sys/devices/system/node)
+  explicit ThreadPool(uint threads = 0, bool pin_threads = false);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  // Number of threads running the loops, the calling one included
+  uint size() const { return m_workers.size() + 1; }
+
+  // Run f(chunk, begin, end) on chunks contiguous ranges of (0, size(
+  template <typename Func>
+  void parallel_chunks(const uint size, const uint chunks, Func f) {
+    if (chunks == 0) return;
+    const uint chunk_size = (size + chunks - 1) / chunks;
+    run(chunks, [&](uint chunk) {
+      const uint begin = std::min(size, chunk * chunk_size);
+      const uint end = std::min(size, begin + chunk_size);
+      f(chunk, begin, end);
+    });
+  }
+
+  // Run f(begin, end) on ranges of (0, size( of at least min_chunk_size
+  // indices (a few chunks per thread to balance the load)
+  template <typename Func>
+  void parallel_for(const uint size, const uint min_chunk_size, Func f) {
+    const uint chunks = std::min<uint>(
+        4 * this->size(), (size + min_chunk_size - 1) / min_chunk_size);
+    parallel_chunks(size, chunks,
+                    [&](uint, uint begin, uint end) { f(begin, end); });
+  }
+
+ private:
+  // Chunks (front, back( of the current loop left in the queue of a worker
+  struct alignas(64) Queue {
+    std::mutex mutex;
+    uint front = 0;
+    uint back = 0;
+  };
+
+  // Run task(chunk) on the chunks, the task is called through a function
+  // pointer and a pointer to it so that nothing is allocated
+  template <typename Task>
+  void run(const uint chunks, const Task& task) {
+    run(chunks,
+        [](const void* context, uint chunk) {
+          (*static_cast<const Task*>(context))(chunk);
+        },
+        &task);
+  }
+  void run(const uint chunks, void (*call)(const void*, uint),
+           const void* context);
+  void work(const uint worker);
+  bool pop(const uint worker, uint& chunk);
+  void worker_loop(const uint worker);
+
+  std::vector<std::thread> m_workers;
+  std::vector<Queue> m_queues;  // one per worker, the calling thread first
+
+  // Task of the current loop
+  void (*m_call)(const void*, uint) = nullptr;
+  const void* m_context = nullptr;
+  std::atomic<uint> m_pending{0};  // chunks of the current loop not done
+  std::atomic<bool> m_failed{false};  // a chunk of the current loop threw
+  std::exception_ptr m_error;          // first exception of the current loop
+  std::mutex m_error_mutex;            // protects m_error
+  std::atomic<uint> m_generation{0};
+  bool m_stop = false;
+
+  std::mutex m_mutex;  // protects m_stop and wakes up the workers
+  std::condition_variable m_wake;
+  std::mutex m_busy;  // held by the thread running a loop
+};
+
+// Pool shared by every stage (created on first use with one thread per core)
+ThreadPool& default_thread_pool();
+
+// Replace the shared pool, must not be called while it runs a loop
+void set_default_thread_pool(uint threads, bool pin_threads = false);
+
+}  // namespace tnp
@@ -0,0 +1,103 @@
+#include "voxel_grid.h"
+
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+
+#include "thread_pool.h"
+
+namespace tnp {
+
+// Cell coordinates of a voxel, distinct for any extent of the cloud
+using VoxelKey = std::array<int64_t, 3>;
+
+struct VoxelKeyHash {
+  size_t operator()(const VoxelKey& key) const {
+    uint64_t hash = 0;
+    for (int64_t c : key) {
+      hash = (hash ^ uint64_t(c)) * 0x9e3779b97f4a7c15ull;
+      hash ^= hash >> 32;
+    }
+    return hash;
+  }
+};
+
+// Cells are clamped below 2^62 so that the conversion to int64 is defined,
+// farther cells are beyond the float precision of the points anyway
+constexpr double MAX_CELL = double(int64_t(1) << 62);
+
+struct VoxelAccumulator {
+  Eigen::Vector3f point_sum = Eigen::Vector3f::Zero();
+  Eigen::Vector3f normal_sum = Eigen::Vector3f::Zero();
+  uint count = 0;
+};
+
+void voxel_downsample(const std::vector<Eigen::Vector3f>& points,
+                      const std::vector<Eigen::Vector3f>* normals,
+                      const float voxel_size,
+                      std::vector<Eigen::Vector3f>& downsampled_points,
+                      std::vector<Eigen::Vector3f>& downsampled_normals) {
+  downsampled_points.clear();
+  downsampled_normals.clear();
+  if (points.empty()) return;
+
+  ThreadPool& pool = default_thread_pool();
+  const uint threads =
+      std::max(1u, std::min<uint>(pool.size(), points.size() / 4096 + 1));
+
+  Eigen::AlignedBox<float, 3> box;
+  for (const Eigen::Vector3f& p : points) box.extend(p);
+
+  // Key of the voxel of each point, and points of each chunk per shard
+  std::vector<VoxelKey> keys(points.size());
+  std::vector<std::vector<std::vector<uint>>> buckets(
+      threads, std::vector<std::vector<uint>>(threads));
+  pool.parallel_chunks(
+      points.size(), threads, [&](uint t, uint begin, uint end) {
+        for (uint i = begin; i < end; i++) {
+          VoxelKey& key = keys[i];
+          for (uint d = 0; d < 3; d++) {
+            // NaN coordinates go to the first cell
+            const double cell =
+                (double(points[i][d]) - box.min()[d]) / voxel_size;
+            key[d] = int64_t(std::min(MAX_CELL, std::max(0., cell)));
+          }
+          buckets[t][VoxelKeyHash()(key) % threads].push_back(i);
+        }
+      });
+
+  // Each thread accumulates the voxels of its shard, in first seen order
+  std::vector<std::vector<VoxelAccumulator>> shards(threads);
+  pool.parallel_chunks(threads, threads, [&](uint shard, uint, uint) {
+    std::unordered_map<VoxelKey, uint, VoxelKeyHash> voxel_of_key;
+    std::vector<VoxelAccumulator>& voxels = shards[shard];
+    for (uint t = 0; t < threads; t++) {
+      for (uint i : buckets[t][shard]) {
+        auto [it, inserted] =
+            voxel_of_key.try_emplace(keys[i], voxels.size());
+        if (inserted) voxels.emplace_back();
+        VoxelAccumulator& voxel = voxels[it->second];
+
+        voxel.point_sum += points[i];
+        if (normals != nullptr) {
+          // Unoriented normals are flipped towards the first one of the voxel
+          const Eigen::Vector3f& n = (*normals)[i];
+          voxel.normal_sum += voxel.normal_sum.dot(n) < 0 ? -n : n;
+        }
+        voxel.count++;
+      }
+    }
+  });
+
+  for (const std::vector<VoxelAccumulator>& voxels : shards) {
+    for (const VoxelAccumulator& voxel : voxels) {
+      downsampled_points.push_back(voxel.point_sum / voxel.count);
+      if (normals != nullptr)
+        downsampled_normals.push_back(voxel.normal_sum.normalized());
+    }
+  }
+}
+
+}  // namespace tnp
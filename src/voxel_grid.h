@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <vector>
+
+namespace tnp {
+
+// Replace the points of each occupied voxel of size voxel_size by their
+// centroid (and, if normals is not nullptr, their mean normal).
+// Voxels are hashed so that memory only depends on the occupied voxels and
+// are accumulated in parallel, each thread owning a shard of the hash space.
+void voxel_downsample(const std::vector<Eigen::Vector3f>& points,
+                      const std::vector<Eigen::Vector3f>* normals,
+                      const float voxel_size,
+                      std::vector<Eigen::Vector3f>& downsampled_points,
+                      std::vector<Eigen::Vector3f>& downsampled_normals);
+
+}  // namespace tnp
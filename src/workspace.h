@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "kdtree.h"
+#include "normal_index.h"
+#include "pyramid.h"
+#include "quantized.h"
+#include "shapes.h"
+
+namespace tnp {
+
+// Hypothesis and its score (its number of inliers with the default scoring)
+template <typename Shape>
+struct Hypothesis {
+  Shape shape;
+  double score;
+};
+
+// Hypothesis kept across the rounds of ransac_multi with the score of the
+// search that found it, its front and back inliers among the remaining points
+// (and, if enabled, the bitsets of these inliers among all the points)
+struct CachedHypothesis {
+  AnyShape shape;
+  double score;
+  uint front;
+  uint back;
+  std::vector<uint64_t> front_bits;
+  std::vector<uint64_t> back_bits;
+};
+
+struct SharedIndex;
+
+//
+// Scratch buffers and random state reused by ransac and ransac_multi.
+// Buffers only grow, so repeated calls on clouds of similar sizes do not
+// allocate after the first one (except for the optional connectivity, voxel
+// grid and pyramid stages which rebuild their own structures).
+//
+// A workspace must not be used by two calls at the same time.
+//
+// Example:
+//     RansacWorkspace workspace;
+//     Detection detection;
+//     for (const auto& frame : frames)
+//       ransac_multi(frame.points, nullptr, params, workspace, detection);
+//
+struct RansacWorkspace {
+  explicit RansacWorkspace(uint seed = std::mt19937::default_seed)
+      : rng(seed) {}
+
+  std::mt19937 rng;
+
+  // ransac: labels of the points, inliers and outliers of the last fit
+  // (indices into the points given to ransac) and hypotheses being scored
+  std::vector<uint8_t> labels;
+  std::vector<uint> inliers;
+  std::vector<uint> outliers;
+  std::tuple<std::vector<Hypothesis<Plane>>, std::vector<Hypothesis<Sphere>>,
+             std::vector<Hypothesis<Cylinder>>>
+      hypotheses;
+
+  // ransac_multi: remaining points (indices into the input and copies)
+  std::vector<uint> remaining;
+  std::vector<uint> next_remaining;
+  std::vector<uint> object_indices;
+  std::vector<Eigen::Vector3f> remaining_points;
+  std::vector<Eigen::Vector3f> remaining_normals;
+  std::vector<uint8_t> active;
+  std::vector<int> slots;
+  std::vector<AnyShape> seeds;  // shapes of the previous frame not found yet
+  std::vector<CachedHypothesis> hypothesis_cache;
+  std::vector<CachedHypothesis> cache_candidates;
+  std::vector<uint64_t> removed_bits;  // points of the objects found so far
+  std::vector<std::vector<uint64_t>> spare_bitsets;  // of dropped hypotheses
+
+  // ransac_multi: search structures, those of shared_index are used instead
+  // when they match the parameters (shared_index is not owned)
+  const SharedIndex* shared_index = nullptr;
+  KdTree kdtree;
+  Pyramid pyramid;
+  std::vector<Eigen::Vector3f> coarse_points;
+  std::vector<Eigen::Vector3f> coarse_normals;
+  QuantizedCloud quantized_cloud;  // of the remaining points
+  NormalIndex normal_index;  // of the points searched in the current round
+};
+
+}  // namespace tnp